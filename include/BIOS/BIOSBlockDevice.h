@@ -7,34 +7,74 @@
 #ifndef BIOS_BLOCK_DEVICE_H
 #define BIOS_BLOCK_DEVICE_H
 
+#include "BIOS/BiosCall.h"
 #include "BIOS/BiosDisk.h"
 #include "device/IBlockDevice.h"
+#include "pm86.h"
 
 #include <cstdint>
 
+/*
+  Block device on top of the BIOS disk services, for protected mode code.
+
+  The BIOS can only write to real-mode addressable memory. Requests that
+  go elsewhere are transferred through the bounce buffer, which must be
+  located below 64k.
+*/
 class BIOSBlockDevice : public IBlockDevice {
 public:
 	BIOSBlockDevice() = delete;
 
-	BIOSBlockDevice(BiosDisk disk, uint32_t offset) {
-		if (!disk.ReadDriveParameters(_geometry)) {
+	BIOSBlockDevice(BiosDisk disk, uint32_t offset,
+			void *bounce, size_t bounceSize) {
+		BiosDisk::DriveGeometry geometry;
+
+		_drive = disk.DriveNumber();
+
+		if (!RealModeCall(BiosDiskReadGeometry, _drive, &geometry)) {
 			_isInitialized = false;
 			return;
 		}
 
-		_disk = disk;
+		_geometry = geometry;
 		_partStart = offset;
-		_isInitialized = true;
+		_sectorSize = 512;
+		_haveLBA = RealModeCall(BiosDiskHasExtensions, _drive) != 0;
+		_bounce = (uint8_t *)bounce;
+
+		// Native 4K disks report their real sector size here
+		if (_haveLBA) {
+			BiosDisk::DriveParametersExt param;
+
+			if (RealModeCall(BiosDiskReadParametersExt,
+					 _drive, &param)) {
+				auto size = param.BytesPerSector();
+
+				if (size >= 512 && size <= 4096 &&
+				    (size & (size - 1)) == 0) {
+					_sectorSize = size;
+				}
+			}
+		}
+
+		_bounceCount = bounceSize / _sectorSize;
+		_isInitialized = _bounceCount > 0;
 	}
 
 	virtual bool LoadSector(uint32_t index, void *buffer) override final {
-		auto chs = _geometry.LBA2CHS(_partStart + index);
+		return Read(index, (uint8_t *)buffer, 1);
+	}
+
+	virtual bool Submit(BlockRequest &req) override final {
+		req.success = Read(req.index, (uint8_t *)req.buffer, req.count);
 
-		return _disk.LoadSectors(chs, buffer, 1);
+		if (req.completion != nullptr)
+			req.completion(req);
+		return true;
 	}
 
 	virtual uint16_t SectorSize() const override final {
-		return 512;
+		return _sectorSize;
 	}
 
 	const auto &DriveGeometry() const {
@@ -44,11 +84,66 @@ public:
 	bool IsInitialized() const {
 		return _isInitialized;
 	}
+
+	bool HaveLBA() const {
+		return _haveLBA;
+	}
 private:
+	bool Read(uint32_t index, uint8_t *buffer, uint32_t count) {
+		// A single transfer must fit into a 64k segment
+		uint32_t max = (0x10000 - 0x10) / _sectorSize;
+		if (max > 127)
+			max = 127;
+
+		if (!_haveLBA)
+			max = 1;
+
+		while (count > 0) {
+			auto diff = count > max ? max : count;
+			auto size = diff * _sectorSize;
+
+			// LBA transfers can go anywhere in conventional memory
+			bool direct = _haveLBA &&
+				((uintptr_t)buffer + size) <= 0xA0000;
+
+			if (!direct && diff > _bounceCount) {
+				diff = _bounceCount;
+				size = diff * _sectorSize;
+			}
+
+			auto *out = direct ? buffer : _bounce;
+
+			if (!LoadSectors(_partStart + index, out, diff))
+				return false;
+
+			if (!direct)
+				CopyMemory32(buffer, _bounce, size);
+
+			buffer += size;
+			index += diff;
+			count -= diff;
+		}
+
+		return true;
+	}
+
+	bool LoadSectors(uint32_t lba, void *out, uint32_t count) {
+		if (_haveLBA)
+			return RealModeCall(BiosDiskLoadLBA, _drive, lba, out,
+					    count);
+
+		return RealModeCall(BiosDiskLoadCHS, _drive, &_geometry,
+				    lba, out);
+	}
+
 	bool _isInitialized;
+	bool _haveLBA;
+	uint8_t _drive;
+	uint16_t _sectorSize;
 	BiosDisk::DriveGeometry _geometry;
 	uint32_t _partStart;
-	BiosDisk _disk{0};
+	uint8_t *_bounce;
+	size_t _bounceCount;
 };
 
 #endif /* BIOS_BLOCK_DEVICE_H */
@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * BIOSTextMode32.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef BIOS_TEXT_MODE_32_H
+#define BIOS_TEXT_MODE_32_H
+
+#include "BIOS/BiosCall.h"
+#include "pm86.h"
+
+#include <cstdint>
+
+// BIOSTextMode for protected mode code, calls the BIOS through a thunk
+class BIOSTextMode32 {
+public:
+	void Reset() {
+		RealModeCall(BiosVideoReset);
+	}
+
+	void PutChar(uint8_t c) {
+		RealModeCall(BiosVideoPutChar, (uint32_t)c);
+	}
+};
+
+#endif /* BIOS_TEXT_MODE_32_H */
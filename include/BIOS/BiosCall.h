@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * BiosCall.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef BIOS_CALL_H
+#define BIOS_CALL_H
+
+#include "BIOS/BiosDisk.h"
+
+#include <cstdint>
+
+/*
+  16 bit helpers that wrap BIOS services. Those are real-mode code and
+  must only be called through RealModeCall() from protected mode. They
+  return non-zero on success.
+
+  Output arguments should be on the stack, below 64k. Some BIOSes
+  reset the segment limits, so memory above that may not be reachable
+  once the interrupt returns.
+*/
+extern "C" {
+	int BiosEnableA20();
+
+	int BiosVideoReset();
+
+	int BiosVideoPutChar(uint32_t c);
+
+	int BiosDiskReadGeometry(uint32_t drive, BiosDisk::DriveGeometry *out);
+
+	int BiosDiskHasExtensions(uint32_t drive);
+
+	int BiosDiskReadParametersExt(uint32_t drive,
+				      BiosDisk::DriveParametersExt *out);
+
+	// The output buffer must be below 1M
+	int BiosDiskLoadLBA(uint32_t drive, uint32_t lba, void *out,
+			    uint32_t count);
+
+	// Loads a single sector, the output buffer must be below 64k
+	int BiosDiskLoadCHS(uint32_t drive,
+			    const BiosDisk::DriveGeometry *geometry,
+			    uint32_t lba, void *out);
+
+	// Jumps to the real-mode entry point of a Linux kernel, never returns
+	int BiosBootLinux(uint32_t segment, uint32_t stack);
+}
+
+#endif /* BIOS_CALL_H */
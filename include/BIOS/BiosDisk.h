@@ -9,6 +9,7 @@
 
 #include <cstdint>
 #include "part/CHSPacked.h"
+#include "types/UnalignedInt.h"
 
 class BiosDisk {
 public:
@@ -17,6 +18,10 @@ public:
 	BiosDisk(uint8_t driveNum) : _driveNum(driveNum) {
 	}
 
+	uint8_t DriveNumber() const {
+		return _driveNum;
+	}
+
 	inline bool Reset() {
 		int error;
 		__asm__ __volatile__ ("int $0x13\r\n"
@@ -30,8 +35,7 @@ public:
 				void *out, uint8_t count) const {
 		uint16_t dx = (static_cast<uint16_t>(source.Head()) << 8) |
 			_driveNum;
-		uint16_t cx = (source.Cylinder() << 8) |
-			((source.Cylinder() & 0x0300) >> 2) | source.Sector();
+		uint16_t cx = source.SectorCylinder();
 
 		int error;
 
@@ -60,6 +64,82 @@ public:
 		}
 	};
 
+	struct DiskAddressPacket {
+		DiskAddressPacket(uint32_t lba, void *out, uint16_t count) :
+			_count(count), _lba(lba) {
+			auto linear = (uintptr_t)out;
+
+			_offset = linear & 0x0F;
+			_segment = linear >> 4;
+		}
+	private:
+		uint8_t _size = sizeof(DiskAddressPacket);
+		uint8_t _pad0 = 0;
+		uint16_t _count;
+		uint16_t _offset;
+		uint16_t _segment;
+		uint64_t _lba;
+	};
+
+	static_assert(sizeof(DiskAddressPacket) == 16);
+
+	class DriveParametersExt {
+	public:
+		uint16_t BytesPerSector() const {
+			return _bytesPerSector.Read();
+		}
+
+		uint64_t SectorCount() const {
+			return _sectorCount.Read();
+		}
+	private:
+		UnalignedInt<uint16_t> _size = sizeof(DriveParametersExt);
+		UnalignedInt<uint16_t> _flags;
+		UnalignedInt<uint32_t> _cylinders;
+		UnalignedInt<uint32_t> _heads;
+		UnalignedInt<uint32_t> _sectorsPerTrack;
+		UnalignedInt<uint64_t> _sectorCount;
+		UnalignedInt<uint16_t> _bytesPerSector;
+	};
+
+	static_assert(sizeof(DriveParametersExt) == 26);
+
+	// Check if the INT 13h extensions (packet interface) are supported
+	bool HasExtensions() const {
+		uint16_t ax = 0x4100, bx = 0x55AA, cx = 0, dx = _driveNum;
+		int error;
+		__asm__ __volatile__ ("int $0x13\r\n"
+				      "sbb %0,%0"
+				      : "=r"(error), "+a"(ax), "+b"(bx),
+					"+c"(cx), "+d"(dx));
+		return error == 0 && bx == 0xAA55 && (cx & 0x01);
+	}
+
+	bool LoadSectorsLBA(uint32_t lba, void *out, uint16_t count) const {
+		DiskAddressPacket dap(lba, out, count);
+		uint16_t ax = 0x4200;
+		int error;
+
+		__asm__ __volatile__ ("int $0x13\r\n"
+				      "sbb %0,%0"
+				      : "=r"(error), "+a"(ax)
+				      : "d"(_driveNum), "S"(&dap)
+				      : "memory");
+		return error == 0;
+	}
+
+	bool ReadDriveParametersExt(DriveParametersExt &out) const {
+		uint16_t ax = 0x4800;
+		int error;
+
+		__asm__ __volatile__ ("int $0x13\r\n"
+				      "sbb %0,%0"
+				      : "=r"(error), "+a"(ax)
+				      : "d"(_driveNum), "S"(&out)
+				      : "memory");
+		return error == 0;
+	}
+
 	bool ReadDriveParameters(DriveGeometry &out) const {
 		uint16_t cxOut, dxOut;
 		int error;
@@ -8,6 +8,7 @@
 #define BIOS_MEMORY_MAP_H
 
 #include "types/UnalignedInt.h"
+#include "pm86.h"
 
 #include <cstdint>
 
@@ -31,9 +32,11 @@ public:
 		/*
 		  XXX: Linux memory.c says that some BIOSes assume we always
 		  use the same buffer, so we use a static scratch buffer for
-		  the call and copy the result afterwards.
+		  the call and copy the result afterwards. This also keeps
+		  it below 64k, where the real-mode code can hand it over.
 		*/
-		auto ret = IntCallE820(&ebxInOut, (uint8_t *)&temp);
+		auto ret = RealModeCall(IntCallE820, &ebxInOut,
+					(uint8_t *)&temp);
 		*this = temp;
 
 		return ret;
@@ -0,0 +1,576 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * BootLoader.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef BOOT_LOADER_H
+#define BOOT_LOADER_H
+
+#include "BIOS/MemoryMap.h"
+#include "kernel/MultiBootHeader.h"
+#include "kernel/LinuxSetupHeader.h"
+#include "hash/ImageVerifier.h"
+#include "device/TextScreen.h"
+#include "fs/FatFs.h"
+#include "StringUtil.h"
+#include "Memory.h"
+#include "pm86.h"
+
+template<class T>
+static TextScreen<T> &operator<< (TextScreen<T> &s, FatFs::FindResult type)
+{
+	const char *str = "no such file or directory";
+
+	switch (type) {
+	case FatFs::FindResult::Ok: str = "ok"; break;
+	case FatFs::FindResult::NameInvalid: str = "name invalid"; break;
+	case FatFs::FindResult::IOError: str = "I/O error"; break;
+	case FatFs::FindResult::NotDir:
+		str = "component is not a directory";
+		break;
+	default:
+		break;
+	}
+
+	s << str;
+	return s;
+}
+
+/*
+  The image loading commands of the boot config, i.e. multiboot, module,
+  linux, initrd and verify. Shared by stage2 and the native test harness.
+
+  OUT is a TextScreen for the messages. MEM provides access to physical
+  memory, through a static Map(address, size) that returns a pointer to
+  the range, or nullptr if it cannot be accessed.
+
+  A zero initialized object is valid, so it can be a static in stage2.
+*/
+template<class OUT, class MEM>
+class BootLoader {
+public:
+	static constexpr size_t MaxModules = 8;
+	static constexpr uint32_t MultiBootMaxSearch = 8192;
+
+	// real-mode part of a Linux kernel, followed by its heap and command line
+	static constexpr uint32_t LinuxSetupAddress = 0x80000;
+	static constexpr uint32_t LinuxSetupMaxSize = 0x8000;
+	static constexpr uint16_t LinuxHeapEnd = 0xE000;
+	static constexpr uint32_t LinuxCmdLineMax = 0x10000 - LinuxHeapEnd - 1;
+
+	struct Module {
+		uint32_t start;
+		uint32_t end;
+		const char *string;
+	};
+
+	void Init(OUT *out, FatFs *fs, const MemoryMap<32> *mmap,
+		  uint32_t chunkSize) {
+		_out = out;
+		_fs = fs;
+		_mmap = mmap;
+		_chunkSize = chunkSize;
+	}
+
+	bool HaveKernel() const {
+		return _haveKernel;
+	}
+
+	bool HaveLinux() const {
+		return _haveLinux;
+	}
+
+	void *KernelEntry() const {
+		return _kernelEntry;
+	}
+
+	size_t ModuleCount() const {
+		return _moduleCount;
+	}
+
+	const Module &ModuleAt(size_t i) const {
+		return _modules[i];
+	}
+
+	bool CmdVerify(const char *arg) {
+		if (!_verifier.Expect(arg)) {
+			Out() << "Error: "
+			      << "expected <crc32c|sha256> <hex digest>"
+			      << "\r\n";
+			return Fail();
+		}
+
+		return true;
+	}
+
+	bool CmdMultiboot(const char *path) {
+		FatFile finfo;
+
+		if (!FindFile(path, finfo))
+			return Fail();
+
+		uint32_t offset;
+		MultiBootHeader hdr;
+
+		if (!MBFindHeader(finfo, offset, hdr)) {
+			Out() << "Error: " << "No multiboot header found!"
+			      << "\r\n";
+			return Fail();
+		}
+
+		if (hdr.Flags().IsSet(MultiBootHeader::KernelFlags::WantVidmode)) {
+			Out() << "Error: "
+			      << "video mode info required (unsupported)!"
+			      << "\r\n";
+			return Fail();
+		}
+
+		if (!hdr.Flags().IsSet(MultiBootHeader::KernelFlags::HaveLayoutInfo)) {
+			Out() << "Error: "
+			      << "No memory layout provided (unsupported)!"
+			      << "\r\n";
+			return Fail();
+		}
+
+		_haveKernel = false;
+		_haveLinux = false;
+		_moduleCount = 0;
+
+		if (!MBLoadKernel(finfo, hdr, offset))
+			return Fail();
+
+		_haveKernel = true;
+		_kernelEntry = hdr.EntryPoint();
+		return true;
+	}
+
+	bool CmdModule(const char *arg) {
+		FatFile finfo;
+
+		if (!_haveKernel) {
+			Out() << "Error: " << "no kernel loaded yet!" << "\r\n";
+			return Fail();
+		}
+
+		if (_moduleCount >= MaxModules) {
+			Out() << "Error: " << "too many modules!" << "\r\n";
+			return Fail();
+		}
+
+		// the script buffer is gone once the kernel runs, keep a copy
+		size_t len = 0;
+		while (arg[len] != '\0')
+			++len;
+
+		auto *str = (char *)malloc(2 * (len + 1));
+		if (str == nullptr) {
+			Out() << "out of memory" << "\r\n";
+			return Fail();
+		}
+
+		char *path = str + len + 1;
+
+		for (size_t i = 0; i <= len; ++i) {
+			str[i] = arg[i];
+			path[i] = IsSpace(arg[i]) ? '\0' : arg[i];
+		}
+
+		if (!FindFile(path, finfo)) {
+			free(str);
+			return Fail();
+		}
+
+		// modules are page aligned and placed after the kernel
+		uint32_t start = (_loadEnd + 0xFFF) & ~0xFFFU;
+
+		if (!IsUsableMemory(start, (uint64_t)start + finfo.size)) {
+			Out() << "Error: " << "module does not fit into memory!"
+			      << "\r\n";
+			free(str);
+			return Fail();
+		}
+
+		auto size = LoadTo(finfo, start, 0, finfo.size);
+		if (size < 0) {
+			free(str);
+			return Fail();
+		}
+
+		_loadEnd = start + size;
+		_modules[_moduleCount].start = start;
+		_modules[_moduleCount].end = _loadEnd;
+		_modules[_moduleCount].string = str;
+		_moduleCount += 1;
+		return true;
+	}
+
+	bool CmdLinux(const char *arg) {
+		auto *setup = MEM::Map(LinuxSetupAddress, 0x10000);
+		FatFile finfo;
+		size_t len = 0;
+
+		if (setup == nullptr) {
+			Out() << "Error: " << "no memory for the setup code!"
+			      << "\r\n";
+			return Fail();
+		}
+
+		while (arg[len] != '\0' && !IsSpace(arg[len]))
+			++len;
+
+		// use the command line area as scratch space for the path
+		auto *cmdLine = (char *)setup + LinuxHeapEnd;
+
+		if (len > LinuxCmdLineMax) {
+			Out() << "Error: " << "path too long!" << "\r\n";
+			return Fail();
+		}
+
+		for (size_t i = 0; i < len; ++i)
+			cmdLine[i] = arg[i];
+
+		cmdLine[len] = '\0';
+
+		if (!FindFile(cmdLine, finfo))
+			return Fail();
+
+		_haveKernel = false;
+		_haveLinux = false;
+		_moduleCount = 0;
+
+		if (!VerifyBegin())
+			return Fail();
+
+		if (!LinuxLoadKernel(finfo) || !VerifyEnd())
+			return Fail();
+
+		// copy the command line, truncated to what the kernel accepts
+		auto *hdr = LinuxHeader();
+		auto max = hdr->CmdLineSize();
+		if (max > LinuxCmdLineMax)
+			max = LinuxCmdLineMax;
+
+		arg += len;
+		while (IsSpace(*arg))
+			++arg;
+
+		for (len = 0; len < max && arg[len] != '\0'; ++len)
+			cmdLine[len] = arg[len];
+
+		cmdLine[len] = '\0';
+
+		hdr->SetLoader(LinuxHeapEnd);
+		hdr->SetCmdLine(LinuxSetupAddress + LinuxHeapEnd);
+		hdr->SetRamdisk(0, 0);
+		_haveLinux = true;
+		return true;
+	}
+
+	bool CmdInitrd(const char *path) {
+		FatFile finfo;
+
+		if (!_haveLinux) {
+			Out() << "Error: " << "no Linux kernel loaded yet!"
+			      << "\r\n";
+			return Fail();
+		}
+
+		if (!FindFile(path, finfo))
+			return Fail();
+
+		auto *hdr = LinuxHeader();
+		uint32_t low = (_loadEnd + 0xFFF) & ~0xFFFU;
+		auto start = LinuxFindInitrd(finfo.size, low,
+					     hdr->InitrdAddrMax());
+
+		if (start == 0) {
+			Out() << "Error: " << "no room for the initrd!" << "\r\n";
+			return Fail();
+		}
+
+		auto size = LoadTo(finfo, start, 0, finfo.size);
+		if (size < 0)
+			return Fail();
+
+		hdr->SetRamdisk(start, size);
+		return true;
+	}
+private:
+	OUT &Out() {
+		return *_out;
+	}
+
+	// Whatever a failed command leaves behind must never be booted
+	bool Fail() {
+		_verifier.Cancel();
+		_haveKernel = false;
+		_haveLinux = false;
+		return false;
+	}
+
+	bool FindFile(const char *path, FatFile &finfo) {
+		auto ret = _fs->FindByPath(path, finfo);
+
+		if (ret != FatFs::FindResult::Ok) {
+			Out() << path << ": " << ret << "\r\n";
+			return false;
+		}
+
+		return true;
+	}
+
+	bool VerifyBegin() {
+		if (!_verifier.Begin()) {
+			Out() << "out of memory" << "\r\n";
+			return false;
+		}
+
+		return true;
+	}
+
+	bool VerifyEnd() {
+		if (!_verifier.End()) {
+			Out() << "Error: " << "checksum mismatch!" << "\r\n";
+			return false;
+		}
+
+		return true;
+	}
+
+	int32_t LoadImage(const FatFile &finfo, uint8_t *buffer,
+			  uint32_t offset, uint32_t count) {
+		uint32_t total = 0;
+
+		// Hash each chunk right after loading it, while it is cached
+		while (total < count) {
+			auto diff = count - total;
+			if (diff > _chunkSize)
+				diff = _chunkSize;
+
+			auto ret = _fs->ReadAt(finfo, buffer + total,
+					       offset + total, diff);
+			if (ret < 0)
+				return -1;
+
+			_verifier.Update(buffer + total, ret);
+
+			total += ret;
+			if ((uint32_t)ret < diff)
+				break;
+		}
+
+		return total;
+	}
+
+	// A whole file to a physical address, checked against the digest
+	int32_t LoadTo(const FatFile &finfo, uint32_t address,
+		       uint32_t offset, uint32_t count) {
+		auto *buffer = MEM::Map(address, count);
+
+		if (buffer == nullptr) {
+			Out() << "Error: " << "load address out of range!"
+			      << "\r\n";
+			return -1;
+		}
+
+		Out() << "Loading " << count << " bytes to #";
+		Out().WriteHex(address);
+		Out() << "\r\n";
+
+		if (!VerifyBegin())
+			return -1;
+
+		auto ret = LoadImage(finfo, buffer, offset, count);
+		if (ret < 0 || !VerifyEnd())
+			return -1;
+
+		return ret;
+	}
+
+	bool MBFindHeader(const FatFile &finfo, uint32_t &offset,
+			  MultiBootHeader &hdr) {
+		auto scanSize = finfo.size > MultiBootMaxSearch ?
+			MultiBootMaxSearch : finfo.size;
+
+		auto *buffer = (uint32_t *)malloc(1024);
+		if (buffer == nullptr) {
+			Out() << "out of memory" << "\r\n";
+			return false;
+		}
+
+		for (offset = 0; offset < scanSize; ) {
+			auto ret = _fs->ReadAt(finfo, (uint8_t *)buffer,
+					       offset, 1024);
+			if (ret <= 0)
+				goto fail;
+
+			for (decltype(ret) i = 0; i < (ret / 4); ++i) {
+				if (buffer[i] != MultiBootHeader::Magic)
+					continue;
+
+				ret = _fs->ReadAt(finfo, (uint8_t *)&hdr,
+						  offset + i * 4, sizeof(hdr));
+				if (ret <= 0)
+					goto fail;
+
+				if (hdr.IsValid()) {
+					offset += i * 4;
+					free(buffer);
+					return true;
+				}
+			}
+
+			offset += ret;
+		}
+	fail:
+		free(buffer);
+		return false;
+	}
+
+	bool MBLoadKernel(const FatFile &finfo, const MultiBootHeader &hdr,
+			  uint32_t fileOffset) {
+		uint32_t fileStart, memStart, count;
+
+		if (!hdr.ExtractMemLayout(fileOffset, finfo.size, fileStart,
+					  memStart, count)) {
+			Out() << "Error: " << "Memory layout is broken!"
+			      << "\r\n";
+			return false;
+		}
+
+		// TODO: check if target actually is in high-mem
+		// TODO: check if we have enough memory available there
+		auto *image = MEM::Map(memStart, count + hdr.BSSSize());
+		if (image == nullptr) {
+			Out() << "Error: " << "load address out of range!"
+			      << "\r\n";
+			return false;
+		}
+
+		auto ret = LoadTo(finfo, memStart, fileStart, count);
+		if (ret < 0)
+			return false;
+
+		ClearMemory32(image + ret, hdr.BSSSize());
+		_loadEnd = memStart + ret + hdr.BSSSize();
+		return true;
+	}
+
+	// Whether [start, end) lies within a single usable memory map entry
+	bool IsUsableMemory(uint64_t start, uint64_t end) const {
+		for (const auto &it : *_mmap) {
+			if (it.Type() != MemoryMapEntry::MemType::Usable)
+				continue;
+
+			uint64_t base = it.BaseAddress();
+
+			if (start >= base && end <= base + it.Size())
+				return true;
+		}
+
+		return false;
+	}
+
+	LinuxSetupHeader *LinuxHeader() const {
+		auto *setup = MEM::Map(LinuxSetupAddress, LinuxSetupMaxSize);
+
+		return (LinuxSetupHeader *)(setup + LinuxSetupHeader::Offset);
+	}
+
+	bool LinuxLoadKernel(const FatFile &finfo) {
+		auto *setup = MEM::Map(LinuxSetupAddress, LinuxSetupMaxSize);
+
+		// the header is in the first two sectors of the setup code
+		auto ret = _fs->ReadAt(finfo, setup, 0, 1024);
+		if (ret < 1024 || !LinuxHeader()->IsValid()) {
+			Out() << "Error: " << "not a bzImage (protocol 2.02+)!"
+			      << "\r\n";
+			return false;
+		}
+
+		auto *hdr = LinuxHeader();
+		auto setupSize = hdr->SetupSize();
+
+		if (setupSize > LinuxSetupMaxSize || setupSize >= finfo.size) {
+			Out() << "Error: " << "setup code too big!" << "\r\n";
+			return false;
+		}
+
+		_verifier.Update(setup, 1024);
+
+		ret = LoadImage(finfo, setup + 1024, 1024, setupSize - 1024);
+		if (ret < 0 || (uint32_t)ret != setupSize - 1024)
+			return false;
+
+		// the protected mode part goes straight to its final location
+		uint32_t memStart = hdr->Code32Start();
+		uint32_t count = finfo.size - setupSize;
+		uint32_t span = hdr->InitSize() > count ? hdr->InitSize() : count;
+		auto *buffer = MEM::Map(memStart, span);
+
+		if (buffer == nullptr ||
+		    !IsUsableMemory(memStart, (uint64_t)memStart + span)) {
+			Out() << "Error: " << "kernel does not fit into memory!"
+			      << "\r\n";
+			return false;
+		}
+
+		Out() << "Loading " << count << " bytes to #";
+		Out().WriteHex(memStart);
+		Out() << "\r\n";
+
+		ret = LoadImage(finfo, buffer, setupSize, count);
+		if (ret < 0)
+			return false;
+
+		// initrd must not be in the way while the kernel decompresses
+		_loadEnd = memStart + span;
+		return true;
+	}
+
+	// Find the highest page aligned spot for an initrd in usable memory
+	uint32_t LinuxFindInitrd(uint32_t size, uint32_t low,
+				 uint32_t high) const {
+		uint32_t best = 0;
+
+		for (const auto &it : *_mmap) {
+			if (it.Type() != MemoryMapEntry::MemType::Usable)
+				continue;
+
+			uint64_t start = it.BaseAddress();
+			uint64_t end = start + it.Size();
+
+			if (end > (uint64_t)high + 1)
+				end = (uint64_t)high + 1;
+			if (start < low)
+				start = low;
+
+			if (end <= start || (end - start) < size)
+				continue;
+
+			uint32_t addr = (end - size) & ~0xFFFULL;
+
+			if (addr >= start && addr > best)
+				best = addr;
+		}
+
+		return best;
+	}
+
+	OUT *_out;
+	FatFs *_fs;
+	const MemoryMap<32> *_mmap;
+	uint32_t _chunkSize;
+
+	ImageVerifier _verifier;
+	bool _haveKernel;
+	bool _haveLinux;
+	void *_kernelEntry;
+	uint32_t _loadEnd;
+
+	Module _modules[MaxModules];
+	size_t _moduleCount;
+};
+
+#endif /* BOOT_LOADER_H */
@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * BootScript.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef BOOT_SCRIPT_H
+#define BOOT_SCRIPT_H
+
+#include "StringUtil.h"
+
+#include <cstddef>
+
+struct BootCommand {
+	const char *name;
+	bool (*callback)(const char *arg);
+};
+
+/*
+  Interprets a boot config file in place, one command per line. Stops at
+  the first failing command and returns false. If the command was not
+  found at all, its name is returned through unknown.
+*/
+template<size_t N>
+static bool RunScript(char *ptr, const BootCommand (&commands)[N],
+		      const char *&unknown)
+{
+	unknown = nullptr;
+
+	while (*ptr != '\0') {
+		// isolate the current line
+		char *line = ptr;
+
+		while (*ptr != '\0' && *ptr != '\n')
+			++ptr;
+
+		if (*ptr == '\n')
+			*(ptr++) = '\0';
+
+		// isolate command string
+		while (*line == ' ' || *line == '\t')
+			++line;
+
+		if (!IsAlnum(*line))
+			continue;
+
+		const char *cmd = line;
+
+		while (IsAlnum(*line))
+			++line;
+
+		if (!IsSpace(*line) || *cmd == '\0' || *cmd == '#')
+			continue;
+
+		*(line++) = '\0';
+
+		while (IsSpace(*line))
+			++line;
+
+		const char *arg = line;
+
+		// dispatch
+		bool found = false;
+
+		for (const auto &it : commands) {
+			if (StrEqual(it.name, cmd)) {
+				if (!it.callback(arg))
+					return false;
+				found = true;
+				break;
+			}
+		}
+
+		if (!found) {
+			unknown = cmd;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+#endif /* BOOT_SCRIPT_H */
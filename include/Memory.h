@@ -11,6 +11,13 @@
 
 extern "C" {
 	void HeapInit(void *basePtr, size_t maxSize);
+}
+
+#if __STDC_HOSTED__
+// Host builds (e.g. test programs) use the C library heap
+#include <cstdlib>
+#else
+extern "C" {
 	void *malloc(size_t count);
 	void free(void *ptr);
 }
@@ -21,6 +28,6 @@ inline void operator delete(void *p) { free(p); }
 inline void operator delete(void *p, size_t) { free(p); }
 inline void operator delete[](void *p) { free(p); }
 inline void operator delete[](void *p, size_t) { free(p); }
+#endif
 
 #endif /* MEMORY_H */
-
@@ -15,13 +15,25 @@
 
 constexpr uint32_t Stage2Magic = 0xD0D0CACA;
 constexpr uint16_t Stage2Location = 0x1000;
+constexpr uint16_t Stage2MaxSize = 30 * 512;
+
+/*
+  A compressed stage2 is inflated right behind the header in place of the
+  loader stub. It must leave room for the stack below the boot sector.
+*/
+constexpr uint16_t Stage2MaxUnpackedSize = 0x7C00 - Stage2Location - 4096;
 
 class Stage2Header {
 public:
-	void SetSectorCount(uint32_t size) {
-		_sectorCount = size / 512;
+	void SetSectorCount(uint32_t size, uint16_t sectorSize = 512) {
+		_sectorShift = 0;
+
+		while ((512U << _sectorShift) < sectorSize)
+			++_sectorShift;
+
+		_sectorCount = size / SectorSize();
 
-		if (size % 512)
+		if (size % SectorSize())
 			_sectorCount += 1;
 	}
 
@@ -29,6 +41,10 @@ public:
 		return _sectorCount;
 	}
 
+	size_t SectorSize() const {
+		return 512U << _sectorShift;
+	}
+
 	void UpdateChecksum() {
 		_checksum = 0;
 		_checksum = ~(ComputeChecksum()) + 1;
@@ -36,7 +52,7 @@ public:
 
 	uint32_t ComputeChecksum() const {
 		auto *ptr = (uint32_t *)this;
-		auto count = _sectorCount * 128;
+		auto count = _sectorCount << (7 + _sectorShift);
 		uint32_t acc = 0;
 
 		while (count--)
@@ -45,6 +61,24 @@ public:
 		return acc;
 	}
 
+	// Sizes of the compressed payload behind the stub and of the result
+	void SetPayloadSize(uint16_t packed, uint16_t unpacked) {
+		_packedSize = packed;
+		_unpackedSize = unpacked;
+	}
+
+	bool IsCompressed() const {
+		return _packedSize != 0;
+	}
+
+	uint16_t PackedSize() const {
+		return _packedSize;
+	}
+
+	uint16_t UnpackedSize() const {
+		return _unpackedSize;
+	}
+
 	bool Verify(uint32_t maxSectors) const {
 		if (_magic != Stage2Magic)
 			return false;
@@ -75,10 +109,14 @@ private:
 	uint32_t _checksum = 0;
 	uint16_t _sectorCount = 0;
 	BiosDisk _biosBootDrive{0};
-	const uint8_t _pad0 = 0;
+	uint8_t _sectorShift = 0;
 	MBREntry _bootMbrEntry{};
+
+	// the stub in stage2/stub.S depends on those offsets
+	uint16_t _packedSize = 0;
+	uint16_t _unpackedSize = 0;
 };
 
-static_assert(sizeof(Stage2Header) == 28);
+static_assert(sizeof(Stage2Header) == 32);
 
 #endif /* STAGE2HEADER_H */
@@ -20,15 +20,37 @@ static bool StrEqual(const char *a, const char *b)
 	return true;
 }
 
-static bool IsSpace(int x)
+[[maybe_unused]] static bool IsSpace(int x)
 {
 	return x == ' ' || x == '\t';
 }
 
-static bool IsAlnum(int x)
+[[maybe_unused]] static bool IsAlnum(int x)
 {
 	return (x >= 'A' && x <= 'Z') || (x >= 'a' && x <= 'z') ||
 		(x >= '0' && x <= '9');
 }
 
+[[maybe_unused]] static int HexDigit(int x)
+{
+	if (x >= '0' && x <= '9')
+		return x - '0';
+	if (x >= 'a' && x <= 'f')
+		return x - 'a' + 10;
+	if (x >= 'A' && x <= 'F')
+		return x - 'A' + 10;
+	return -1;
+}
+
+// Compare the non-terminated string [begin, end) against a word
+[[maybe_unused]] static bool MatchWord(const char *begin, const char *end, const char *word)
+{
+	while (begin < end && *word != '\0') {
+		if (*(begin++) != *(word++))
+			return false;
+	}
+
+	return begin == end && *word == '\0';
+}
+
 #endif /* STRING_UTIL_H */
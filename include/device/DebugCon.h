@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * DebugCon.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef DEBUG_CON_H
+#define DEBUG_CON_H
+
+#include "device/io.h"
+
+#include <cstdint>
+
+/*
+  The Bochs/Qemu debug console (port 0xE9) and the Qemu isa-debug-exit
+  device. Writes to those ports go nowhere on real hardware.
+*/
+class DebugCon {
+public:
+	static constexpr uint16_t Port = 0xE9;
+	static constexpr uint16_t ExitPort = 0xF4;
+
+	// Lets a TextScreen<DebugCon> format output for the port
+	static void PutChar(uint8_t c) {
+		IoWriteByte(Port, c);
+	}
+
+	static void Write(const char *str) {
+		while (*str != '\0')
+			IoWriteByte(Port, *(str++));
+	}
+
+	static void WriteHex(uint64_t value) {
+		for (int i = 60; i >= 0; i -= 4)
+			IoWriteByte(Port, "0123456789ABCDEF"[(value >> i) & 0x0F]);
+	}
+
+	// Emits "@<phase> <time stamp counter>" on a line of its own
+	static void Mark(const char *phase) {
+		uint32_t lo, hi;
+
+		__asm__ __volatile__ ("rdtsc" : "=a"(lo), "=d"(hi));
+
+		IoWriteByte(Port, '@');
+		Write(phase);
+		IoWriteByte(Port, ' ');
+		WriteHex(((uint64_t)hi << 32) | lo);
+		IoWriteByte(Port, '\n');
+	}
+
+	// Qemu exits with status (code << 1) | 1
+	static void Exit(uint8_t code) {
+		IoWriteByte(ExitPort, code);
+	}
+};
+
+#endif /* DEBUG_CON_H */
@@ -8,6 +8,18 @@
 #define IBLOCK_DEVICE_H
 
 #include <cstdint>
+#include <cstddef>
+
+struct BlockRequest {
+	uint32_t index;
+	uint32_t count;
+	void *buffer;
+	bool success;
+
+	// called by the driver once the request is done
+	void (*completion)(BlockRequest &req);
+	void *context;
+};
 
 class IBlockDevice {
 public:
@@ -17,6 +29,60 @@ public:
 	virtual bool LoadSector(uint32_t index, void *buffer) = 0;
 
 	virtual uint16_t SectorSize() const = 0;
+
+	/*
+	  Queue style interface. Drivers that can keep several requests in
+	  flight override those. The default is a synchronous adapter on top
+	  of LoadSector, that completes the request before Submit returns.
+
+	  Submit returns false if the request could not be queued. Otherwise,
+	  the completion callback is called exactly once, from within Submit,
+	  Poll or Wait.
+	*/
+	virtual bool Submit(BlockRequest &req) {
+		auto *ptr = (uint8_t *)req.buffer;
+
+		req.success = true;
+
+		for (uint32_t i = 0; i < req.count; ++i) {
+			if (!LoadSector(req.index + i, ptr)) {
+				req.success = false;
+				break;
+			}
+
+			ptr += SectorSize();
+		}
+
+		if (req.completion != nullptr)
+			req.completion(req);
+		return true;
+	}
+
+	// Process finished requests, returns how many were completed
+	virtual size_t Poll() {
+		return 0;
+	}
+
+	// Block until all submitted requests are completed
+	virtual void Wait() {
+	}
+
+	// Number of requests the driver can keep in flight at the same time
+	virtual size_t QueueDepth() const {
+		return 1;
+	}
+
+	/*
+	  Memory backed devices can hand out a pointer to a range of sectors,
+	  instead of copying them. The pointer stays valid as long as the
+	  device exists. Returns nullptr if the device cannot do that, or
+	  if the range is out of bounds.
+	*/
+	virtual const void *MapSectors(uint32_t index, uint32_t count) {
+		(void)index;
+		(void)count;
+		return nullptr;
+	}
 };
 
 #endif /* IBLOCK_DEVICE_H */
@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * MemoryBlockDevice.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef MEMORY_BLOCK_DEVICE_H
+#define MEMORY_BLOCK_DEVICE_H
+
+#include "device/IBlockDevice.h"
+
+/*
+  A disk image that is already in memory, e.g. a module loaded by the boot
+  loader. Sectors can be copied out like from any other device, but since
+  the data is right there, MapSectors hands out pointers into the image.
+
+  The image is never written to. A trailing partial sector is ignored.
+*/
+class MemoryBlockDevice : public IBlockDevice {
+public:
+	MemoryBlockDevice() = delete;
+
+	MemoryBlockDevice(const void *data, size_t size,
+			  uint16_t sectorSize = 512) :
+		_data((const uint8_t *)data), _sectorCount(size / sectorSize),
+		_sectorSize(sectorSize) {
+	}
+
+	virtual bool LoadSector(uint32_t index, void *buffer) override final {
+		auto *src = (const uint8_t *)MapSectors(index, 1);
+		auto *dst = (uint8_t *)buffer;
+
+		if (src == nullptr)
+			return false;
+
+		for (uint16_t i = 0; i < _sectorSize; ++i)
+			*(dst++) = *(src++);
+
+		return true;
+	}
+
+	virtual uint16_t SectorSize() const override final {
+		return _sectorSize;
+	}
+
+	virtual const void *MapSectors(uint32_t index,
+				       uint32_t count) override final {
+		if (index >= _sectorCount || count > (_sectorCount - index))
+			return nullptr;
+
+		return _data + (size_t)index * _sectorSize;
+	}
+
+	uint32_t SectorCount() const {
+		return _sectorCount;
+	}
+private:
+	const uint8_t *_data;
+	uint32_t _sectorCount;
+	uint16_t _sectorSize;
+};
+
+#endif /* MEMORY_BLOCK_DEVICE_H */
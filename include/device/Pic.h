@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * Pic.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef PIC_H
+#define PIC_H
+
+#include <cstdint>
+
+#include "device/io.h"
+
+/*
+  The pair of cascaded 8259 interrupt controllers. The BIOS leaves the
+  master on vectors 0x08-0x0F, which collide with CPU exceptions in
+  protected mode, so they must be moved before interrupts are enabled.
+*/
+static inline void PicRemap(uint8_t masterBase, uint8_t slaveBase)
+{
+	// ICW1: edge triggered, cascaded, ICW4 follows
+	IoWriteByte(0x20, 0x11);
+	IoWait();
+	IoWriteByte(0xA0, 0x11);
+	IoWait();
+
+	// ICW2: vector base, ICW3: slave on IRQ 2, ICW4: 8086 mode
+	IoWriteByte(0x21, masterBase);
+	IoWait();
+	IoWriteByte(0xA1, slaveBase);
+	IoWait();
+	IoWriteByte(0x21, 0x04);
+	IoWait();
+	IoWriteByte(0xA1, 0x02);
+	IoWait();
+	IoWriteByte(0x21, 0x01);
+	IoWait();
+	IoWriteByte(0xA1, 0x01);
+	IoWait();
+
+	// everything masked
+	IoWriteByte(0x21, 0xFF);
+	IoWriteByte(0xA1, 0xFF);
+}
+
+static inline void PicUnmask(uint8_t irq)
+{
+	uint16_t port = irq < 8 ? 0x21 : 0xA1;
+
+	IoWriteByte(port, IoReadByte(port) & ~(1 << (irq & 0x07)));
+}
+
+static inline void PicEndOfInterrupt(uint8_t irq)
+{
+	if (irq >= 8)
+		IoWriteByte(0xA0, 0x20);
+
+	IoWriteByte(0x20, 0x20);
+}
+
+#endif /* PIC_H */
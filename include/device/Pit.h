@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * Pit.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef PIT_H
+#define PIT_H
+
+#include <cstdint>
+
+#include "device/io.h"
+
+/*
+  Busy waits using channel 2 of the 8254 timer. Its gate and output are
+  wired to port 0x61 (for the PC speaker) instead of an interrupt line, so
+  it can be polled without disturbing channel 0.
+*/
+static inline void PitDelay(uint32_t us)
+{
+	while (us > 0) {
+		uint32_t chunk = us > 50000 ? 50000 : us;
+		uint32_t ticks = chunk * 1193 / 1000;
+
+		if (ticks == 0)
+			ticks = 1;
+
+		// gate low, speaker off, then one shot mode (0), lobyte/hibyte
+		auto ctl = IoReadByte(0x61) & ~0x03;
+
+		IoWriteByte(0x61, ctl);
+		IoWriteByte(0x43, 0xB0);
+		IoWriteByte(0x42, ticks & 0xFF);
+		IoWriteByte(0x42, ticks >> 8);
+
+		// gate high starts counting, output goes high at zero
+		IoWriteByte(0x61, ctl | 0x01);
+
+		while (!(IoReadByte(0x61) & 0x20))
+			;
+
+		us -= chunk;
+	}
+}
+
+#endif /* PIT_H */
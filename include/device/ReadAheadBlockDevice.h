@@ -0,0 +1,209 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * ReadAheadBlockDevice.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef READ_AHEAD_BLOCK_DEVICE_H
+#define READ_AHEAD_BLOCK_DEVICE_H
+
+#include "device/IBlockDevice.h"
+#include "types/UniquePtr.h"
+
+#include <utility>
+
+/*
+  Wraps another block device and detects sequential streams of sector
+  reads. Once a stream is detected, a growing window of sectors is
+  prefetched with a single request, doubling up to the configured limit
+  while the stream continues.
+
+  Each stream gets its own window from a caller supplied buffer pool, so
+  that e.g. walking the FAT in between reading file data does not throw
+  away the data window. Isolated reads are passed through.
+*/
+class ReadAheadBlockDevice : public IBlockDevice {
+public:
+	static constexpr size_t MaxStreams = 2;
+
+	struct Statistics {
+		uint32_t hits;
+		uint32_t misses;
+		uint32_t prefetched;
+		uint32_t prefetches;
+		uint16_t depth;
+		uint16_t maxDepth;
+	};
+
+	ReadAheadBlockDevice() = delete;
+
+	/*
+	  The pool is split evenly between the streams. The window is
+	  capped at maxDepth sectors, or less if the pool is too small.
+	*/
+	ReadAheadBlockDevice(UniquePtr<IBlockDevice> lower, uint16_t maxDepth,
+			     void *pool, size_t poolSize) :
+		_lower(std::move(lower)) {
+		size_t fit = pool == nullptr ? 0 :
+			poolSize / (MaxStreams * SectorSize());
+
+		_stats.hits = 0;
+		_stats.misses = 0;
+		_stats.prefetched = 0;
+		_stats.prefetches = 0;
+		_stats.depth = 0;
+		_stats.maxDepth = fit < maxDepth ? fit : maxDepth;
+
+		for (size_t i = 0; i < MaxStreams; ++i) {
+			_streams[i].data = (uint8_t *)pool +
+				i * _stats.maxDepth * SectorSize();
+			_streams[i].start = 0;
+			_streams[i].count = 0;
+			_streams[i].next = 0xFFFFFFFF;
+			_streams[i].depth = 0;
+		}
+
+		_lastMiss = 0xFFFFFFFE;
+		_victim = 0;
+	}
+
+	virtual bool LoadSector(uint32_t index, void *buffer) override final {
+		for (size_t i = 0; i < MaxStreams; ++i) {
+			auto &s = _streams[i];
+
+			if (index >= s.start && (index - s.start) < s.count) {
+				_stats.hits += 1;
+				_victim = (i + 1) % MaxStreams;
+				s.next = index + 1;
+				CopySector(buffer, s, index);
+				return true;
+			}
+		}
+
+		_stats.misses += 1;
+
+		if (_stats.maxDepth > 1) {
+			Stream *s = nullptr;
+			uint16_t depth = 2;
+
+			for (size_t i = 0; i < MaxStreams; ++i) {
+				if (_streams[i].next == index) {
+					s = _streams + i;
+					depth = s->depth * 2;
+					break;
+				}
+			}
+
+			// two adjacent misses in a row start a new stream
+			if (s == nullptr && index == (_lastMiss + 1))
+				s = _streams + _victim;
+
+			_lastMiss = index;
+
+			if (depth > _stats.maxDepth)
+				depth = _stats.maxDepth;
+
+			if (s != nullptr && Prefetch(*s, index, depth)) {
+				_victim = (s - _streams + 1) % MaxStreams;
+				CopySector(buffer, *s, index);
+				return true;
+			}
+		}
+
+		_lastMiss = index;
+		return _lower->LoadSector(index, buffer);
+	}
+
+	virtual bool Submit(BlockRequest &req) override final {
+		// Large requests are already efficient, let them through
+		if (req.count > 1 && req.count >= _stats.maxDepth) {
+			_lastMiss = req.index + req.count - 1;
+
+			for (auto &s : _streams) {
+				if (s.next == req.index)
+					s.next = req.index + req.count;
+			}
+
+			return _lower->Submit(req);
+		}
+
+		return IBlockDevice::Submit(req);
+	}
+
+	virtual size_t Poll() override final {
+		return _lower->Poll();
+	}
+
+	virtual void Wait() override final {
+		_lower->Wait();
+	}
+
+	virtual size_t QueueDepth() const override final {
+		return _lower->QueueDepth();
+	}
+
+	virtual uint16_t SectorSize() const override final {
+		return _lower->SectorSize();
+	}
+
+	const Statistics &Stats() const {
+		return _stats;
+	}
+private:
+	struct Stream {
+		uint8_t *data;
+		uint32_t start;
+		uint32_t count;
+		uint32_t next;
+		uint16_t depth;
+	};
+
+	bool Prefetch(Stream &s, uint32_t index, uint16_t count) {
+		BlockRequest req;
+
+		req.index = index;
+		req.count = count;
+		req.buffer = s.data;
+		req.success = false;
+		req.completion = nullptr;
+		req.context = nullptr;
+
+		s.count = 0;
+		s.next = 0xFFFFFFFF;
+
+		if (!_lower->Submit(req))
+			return false;
+
+		_lower->Wait();
+
+		if (!req.success)
+			return false;
+
+		s.start = index;
+		s.count = count;
+		s.next = index + 1;
+		s.depth = count;
+
+		_stats.depth = count;
+		_stats.prefetched += count;
+		_stats.prefetches += 1;
+		return true;
+	}
+
+	void CopySector(void *buffer, const Stream &s, uint32_t index) const {
+		auto size = SectorSize();
+		auto *src = s.data + (index - s.start) * size;
+		auto *dst = (uint8_t *)buffer;
+
+		for (decltype(size) i = 0; i < size; ++i)
+			*(dst++) = *(src++);
+	}
+
+	UniquePtr<IBlockDevice> _lower;
+	Statistics _stats;
+	Stream _streams[MaxStreams];
+	uint32_t _lastMiss;
+	size_t _victim;
+};
+
+#endif /* READ_AHEAD_BLOCK_DEVICE_H */
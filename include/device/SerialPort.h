@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * SerialPort.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef SERIAL_PORT_H
+#define SERIAL_PORT_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "device/io.h"
+
+/*
+  Polled, output only driver for a 16550 compatible UART, set to 115200
+  baud 8N1 with the FIFO enabled. Once the transmitter reports that it is
+  empty, a whole FIFO worth of bytes is written without checking again.
+
+  If nothing answers at the port, the driver stays disabled and output is
+  thrown away.
+*/
+class SerialPort {
+public:
+	static constexpr uint16_t Com1 = 0x3F8;
+	static constexpr size_t FifoSize = 16;
+
+	bool Init(uint16_t base = Com1) {
+		_base = base;
+		_present = false;
+
+		// the scratch register keeps its value, if there is a UART
+		IoWriteByte(base + Scratch, 0xAE);
+		if (IoReadByte(base + Scratch) != 0xAE)
+			return false;
+
+		IoWriteByte(base + IntEnable, 0x00);
+		IoWriteByte(base + LineCtl, 0x80);
+		IoWriteByte(base + DivisorLo, 0x01);
+		IoWriteByte(base + DivisorHi, 0x00);
+		IoWriteByte(base + LineCtl, 0x03);
+		IoWriteByte(base + FifoCtl, 0xC7);
+		IoWriteByte(base + ModemCtl, 0x03);
+
+		_present = true;
+		return true;
+	}
+
+	bool IsPresent() const {
+		return _present;
+	}
+
+	void Write(const char *data, size_t count) {
+		if (!_present)
+			return;
+
+		while (count > 0) {
+			WaitEmpty();
+
+			size_t chunk = count < FifoSize ? count : FifoSize;
+
+			for (size_t i = 0; i < chunk; ++i)
+				IoWriteByte(_base + Data, data[i]);
+
+			data += chunk;
+			count -= chunk;
+		}
+	}
+
+	void PutChar(uint8_t c) {
+		if (!_present)
+			return;
+
+		WaitEmpty();
+		IoWriteByte(_base + Data, c);
+	}
+private:
+	enum {
+		Data = 0,
+		DivisorLo = 0,
+		IntEnable = 1,
+		DivisorHi = 1,
+		FifoCtl = 2,
+		LineCtl = 3,
+		ModemCtl = 4,
+		LineStatus = 5,
+		Scratch = 7,
+	};
+
+	void WaitEmpty() {
+		while (!(IoReadByte(_base + LineStatus) & 0x20))
+			;
+	}
+
+	uint16_t _base = Com1;
+	bool _present = false;
+};
+
+#endif /* SERIAL_PORT_H */
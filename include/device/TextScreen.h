@@ -17,6 +17,9 @@ public:
 	void PutChar(uint8_t c) { _driver.PutChar(c); }
 	auto &Driver() { return _driver; }
 
+	// Only for drivers that buffer output, e.g. the VgaConsole
+	void Flush() { _driver.Flush(); }
+
 	void WriteString(const char *str) {
 		while (*str != '\0')
 			_driver.PutChar(*(str++));
@@ -0,0 +1,194 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * VgaConsole.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef VGA_CONSOLE_H
+#define VGA_CONSOLE_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "device/VideoMemory.h"
+#include "device/io.h"
+
+/*
+  Text mode console for the kernel, that only touches the hardware on Flush.
+
+  Characters go into a shadow copy of the screen in regular memory, which
+  keeps track of the lines that changed. Scrolling is done by moving the
+  CRTC start address through the 32k of text mode VRAM, instead of moving
+  the screen contents around. Once the end of VRAM is reached, the visible
+  lines are written back to the top from the shadow buffer.
+
+  Flush copies the dirty lines to VRAM and updates the start address and
+  cursor registers, if they changed. In the kernel, that happens every
+  time the LogConsole is drained.
+*/
+class VgaConsole {
+public:
+	using Color = VideoMemory::Color;
+
+	static constexpr uint16_t Width = 80;
+	static constexpr uint16_t Height = 25;
+	static constexpr uint16_t VramLines = 0x4000 / Width;
+
+	void Reset() {
+		for (auto &row : _shadow) {
+			for (auto &cell : row)
+				cell = Blank();
+		}
+
+		_x = 0;
+		_y = 0;
+		_shadowTop = 0;
+		_scrolled = 0;
+		_top = 0;
+		_dirty = AllLines;
+		_hwStart = 0xFFFF;
+		_hwCursor = 0xFFFF;
+
+		Flush();
+	}
+
+	void PutChar(uint8_t c) {
+		if (c == '\r') {
+			_x = 0;
+			return;
+		}
+
+		if (c == '\n') {
+			NewLine();
+			return;
+		}
+
+		if (c == '\t') {
+			do {
+				PutChar(' ');
+			} while (_x % 8);
+			return;
+		}
+
+		if (c < 0x20 || c > 0x7E)
+			return;
+
+		auto line = ShadowLine(_y);
+
+		_shadow[line][_x] = (uint16_t)(_attrib << 8) | c;
+		_dirty |= 1U << line;
+
+		if (++_x >= Width) {
+			_x = 0;
+			NewLine();
+		}
+	}
+
+	void SetColor(Color foreground, Color background) {
+		_attrib = ((uint8_t)background << 4) | (uint8_t)foreground;
+	}
+
+	void Flush() {
+		if (_scrolled > 0) {
+			uint32_t top = (uint32_t)_top + _scrolled;
+
+			// everything moved off screen, or out of VRAM
+			if (_scrolled >= Height)
+				_dirty = AllLines;
+
+			if ((top + Height) > VramLines) {
+				top = 0;
+				_dirty = AllLines;
+			}
+
+			_top = top;
+			_scrolled = 0;
+		}
+
+		for (uint16_t row = 0; _dirty != 0 && row < Height; ++row) {
+			auto line = ShadowLine(row);
+
+			if (!(_dirty & (1U << line)))
+				continue;
+
+			_dirty &= ~(1U << line);
+
+			auto *src = (const CellPair *)_shadow[line];
+			auto *dst = (volatile CellPair *)VramBase +
+				(_top + row) * (Width / 2);
+
+			for (uint16_t i = 0; i < (Width / 2); ++i)
+				dst[i] = src[i];
+		}
+
+		uint16_t start = _top * Width;
+		uint16_t cursor = start + _y * Width + _x;
+
+		if (start != _hwStart) {
+			WriteCrtc(0x0C, start);
+			_hwStart = start;
+		}
+
+		if (cursor != _hwCursor) {
+			WriteCrtc(0x0E, cursor);
+			_hwCursor = cursor;
+		}
+	}
+private:
+	static constexpr uintptr_t VramBase = 0xB8000;
+	static constexpr uint32_t AllLines = (1UL << Height) - 1;
+
+	static_assert(Height <= 32);
+
+	// two cells at a time, to halve the number of VRAM accesses
+	typedef uint32_t __attribute__((may_alias)) CellPair;
+
+	// Writes a 16 bit register pair, high byte first
+	static void WriteCrtc(uint8_t index, uint16_t value) {
+		IoWriteByte(0x3D4, index);
+		IoWriteByte(0x3D5, value >> 8);
+		IoWriteByte(0x3D4, index + 1);
+		IoWriteByte(0x3D5, value & 0xFF);
+	}
+
+	uint16_t Blank() const {
+		return (uint16_t)(_attrib << 8) | ' ';
+	}
+
+	uint8_t ShadowLine(uint8_t row) const {
+		return (_shadowTop + row) % Height;
+	}
+
+	void NewLine() {
+		if ((_y + 1) < Height) {
+			_y += 1;
+			return;
+		}
+
+		// the old top line becomes the new bottom line
+		auto line = _shadowTop;
+
+		_shadowTop = (_shadowTop + 1) % Height;
+
+		for (auto &cell : _shadow[line])
+			cell = Blank();
+
+		_dirty |= 1U << line;
+
+		if (_scrolled < VramLines)
+			_scrolled += 1;
+	}
+
+	uint16_t _shadow[Height][Width]{};
+	uint32_t _dirty = 0;
+	uint16_t _top = 0;
+	uint16_t _scrolled = 0;
+	uint16_t _hwStart = 0xFFFF;
+	uint16_t _hwCursor = 0xFFFF;
+	uint8_t _shadowTop = 0;
+	uint8_t _x = 0;
+	uint8_t _y = 0;
+	uint8_t _attrib = 0x07;
+};
+
+#endif /* VGA_CONSOLE_H */
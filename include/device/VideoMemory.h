@@ -100,6 +100,7 @@ public:
 		while (dst != end) {
 			dst->SetChar(' ');
 			dst->SetColor(_fg, _bg);
+			++dst;
 		}
 
 		if (_y > 0)
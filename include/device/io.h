@@ -35,7 +35,7 @@ static inline void SetFs(uint16_t seg)
 
 static inline uint8_t Peek(uint16_t seg, uint16_t off)
 {
-	uint8_t *ptr = (uint8_t *)off;
+	uint8_t *ptr = (uint8_t *)(uintptr_t)off;
 	uint8_t v;
 	SetFs(seg);
 	__asm__ __volatile__ ("movb %%fs:%1, %0" : "=q"(v) : "m"(*ptr));
@@ -44,7 +44,7 @@ static inline uint8_t Peek(uint16_t seg, uint16_t off)
 
 static inline void Poke(uint16_t seg, uint16_t off, uint8_t v)
 {
-	uint8_t *ptr = (uint8_t *)off;
+	uint8_t *ptr = (uint8_t *)(uintptr_t)off;
 	SetFs(seg);
 	__asm__ __volatile__ ("movb %1, %%fs:%0" : "+m"(*ptr) : "qi"(v));
 }
@@ -10,6 +10,7 @@
 #include "device/IBlockDevice.h"
 #include "types/FlagField.h"
 #include "types/UniquePtr.h"
+#include "fs/FatDirent.h"
 #include "fs/FatSuper.h"
 #include "fs/FatName.h"
 #include "StringUtil.h"
@@ -30,10 +31,34 @@ public:
 	FatFs(UniquePtr<IBlockDevice> blk, const FatSuper &fsSuper) :
 		_blk(std::move(blk)), super(fsSuper) {
 		currentFatSector = 0xFFFFFFFF;
-		currentDataCluster = 0xFFFFFFFF;
+		currentDataSector = 0xFFFFFFFF;
+		inFlight = 0;
+		requestFailed = false;
+
+		for (auto &it : requests)
+			it.buffer = nullptr;
+
+		windowSectors = super.SectorsPerCluster();
+
+		// memory backed devices: the windows point into the image
+		mapped = _blk->MapSectors(0, 1) != nullptr;
+		fatWindow = nullptr;
+		dataWindow = nullptr;
+		fatView = nullptr;
+		dataView = nullptr;
+
+		if (mapped)
+			return;
+
+		while (windowSectors > 1 &&
+		       (windowSectors * _blk->SectorSize()) > MaxWindowSize) {
+			windowSectors /= 2;
+		}
 
 		fatWindow = (uint8_t *)malloc(_blk->SectorSize());
-		dataWindow = (uint8_t *)malloc(BytesPerCluster());
+		dataWindow = (uint8_t *)malloc(WindowSize());
+		fatView = fatWindow;
+		dataView = dataWindow;
 	}
 
 	~FatFs() {
@@ -47,6 +72,10 @@ public:
 		return super.SectorsPerCluster() * _blk->SectorSize();
 	}
 
+	size_t WindowSize() const {
+		return windowSectors * _blk->SectorSize();
+	}
+
 	auto RootDir() const {
 		FatFile out;
 		out.cluster = super.RootDirIndex();
@@ -67,36 +96,154 @@ public:
 		}
 
 		auto cluster = finfo.cluster;
+		uint32_t runStart = 0, runCount = 0;
+		uint8_t *runBuffer = nullptr;
 		int32_t ret = 0;
 
+		requestFailed = false;
+
 		while (size > 0 && cluster < 0x0FFFFFF0) {
-			if (offset < BytesPerCluster()) {
-				if (!LoadDataCluster(cluster))
-					return -1;
+			if (offset == 0 && size >= BytesPerCluster()) {
+				// Whole clusters go straight to the caller buffer.
+				// Physically contiguous ones are merged into a
+				// single request.
+				if (runCount > 0 && cluster == (runStart + runCount)) {
+					runCount += 1;
+				} else {
+					if (runCount > 0 &&
+					    !SubmitClusters(runStart, runCount,
+							    runBuffer)) {
+						break;
+					}
+
+					runStart = cluster;
+					runCount = 1;
+					runBuffer = buffer;
+				}
+
+				buffer += BytesPerCluster();
+				size -= BytesPerCluster();
+				ret += BytesPerCluster();
+			} else if (offset < BytesPerCluster()) {
+				if (!LoadDataWindow(cluster, offset)) {
+					requestFailed = true;
+					break;
+				}
 
-				uint32_t diff = BytesPerCluster() - offset;
+				auto winOffset = offset % WindowSize();
+				uint32_t diff = WindowSize() - winOffset;
 				if (diff > size)
 					diff = size;
 
 				for (uint32_t i = 0; i < diff; ++i)
-					*(buffer++) = dataWindow[offset + i];
+					*(buffer++) = dataView[winOffset + i];
 
-				offset = 0;
+				offset += diff;
 				size -= diff;
 				ret += diff;
+
+				// continue with the next window in this cluster
+				if (offset < BytesPerCluster())
+					continue;
+
+				offset = 0;
 			} else {
 				offset -= BytesPerCluster();
 			}
 
 			if (size > 0) {
 				uint32_t next;
-				if (!ReadFatIndex(cluster, next))
-					return -1;
+				if (!ReadFatIndex(cluster, next)) {
+					requestFailed = true;
+					break;
+				}
 				cluster = next;
 			}
 		}
 
-		return ret;
+		if (runCount > 0 && !requestFailed)
+			SubmitClusters(runStart, runCount, runBuffer);
+
+		if (inFlight > 0)
+			_blk->Wait();
+
+		return requestFailed ? -1 : ret;
+	}
+
+	/*
+	  Zero-copy version of ReadAt, for memory backed block devices.
+	  Returns a pointer to the file data at the given offset and cuts
+	  size down to what can be read from there, which can span several
+	  physically contiguous clusters. If the device cannot map all of
+	  them (e.g. a truncated image), size only covers the leading ones.
+	  Returns nullptr and sets size to 0 at the end of the file, on
+	  errors, or if the device cannot map the first cluster.
+	*/
+	const uint8_t *MapAt(const FatFile &finfo, uint32_t offset,
+			     uint32_t &size) {
+		auto cluster = finfo.cluster;
+		auto want = size;
+		uint32_t count = 1;
+
+		size = 0;
+
+		if (finfo.size > 0) {
+			if (offset >= finfo.size)
+				return nullptr;
+
+			if (want > (finfo.size - offset))
+				want = (finfo.size - offset);
+		}
+
+		if (!mapped || want == 0)
+			return nullptr;
+
+		while (offset >= BytesPerCluster()) {
+			if (cluster < 2 || cluster >= 0x0FFFFFF0 ||
+			    !ReadFatIndex(cluster, cluster)) {
+				return nullptr;
+			}
+
+			offset -= BytesPerCluster();
+		}
+
+		if (cluster < 2 || cluster >= 0x0FFFFFF0)
+			return nullptr;
+
+		while ((count * BytesPerCluster() - offset) < want) {
+			uint32_t next;
+
+			if (!ReadFatIndex(cluster + count - 1, next))
+				return nullptr;
+
+			if (next != cluster + count)
+				break;
+
+			++count;
+		}
+
+		// a truncated image may not hold the whole run, map what it has
+		const uint8_t *ptr;
+
+		for (;;) {
+			ptr = (const uint8_t *)_blk->MapSectors(
+				super.ClusterIndex2Sector(cluster),
+				count * super.SectorsPerCluster());
+
+			if (ptr != nullptr)
+				break;
+
+			if (count == 1)
+				return nullptr;
+
+			count /= 2;
+		}
+
+		size = count * BytesPerCluster() - offset;
+		if (size > want)
+			size = want;
+
+		return ptr + offset;
 	}
 
 	enum class FindResult {
@@ -119,32 +266,38 @@ public:
 		while (index < 0x0FFFFFF0) {
 			uint32_t next;
 
-			if (!LoadDataCluster(index) || !ReadFatIndex(index, next))
+			if (!ReadFatIndex(index, next))
 				return FindResult::IOError;
 
-			index = next;
-
-			auto *entS = (FatDirent *)dataWindow;
-			auto max = BytesPerCluster() / sizeof(*entS);
-
-			for (decltype(max) i = 0; i < max; ++i) {
-				if (entS[i].IsLastInList())
-					return FindResult::NoEntry;
-				if (entS[i].EntryFlags().IsSet(FatDirent::Flags::LongFileName))
-					continue;
-				if (entS[i].IsDummiedOut())
-					continue;
-
-				char buffer[8 + 1 + 3 + 1];
-				entS[i].NameToString(buffer);
-
-				if (StrEqual(buffer, name)) {
-					out.cluster = entS[i].ClusterIndex();
-					out.size = entS[i].Size();
-					out.flags = entS[i].EntryFlags();
-					return FindResult::Ok;
+			for (uint32_t offset = 0; offset < BytesPerCluster();
+			     offset += WindowSize()) {
+				if (!LoadDataWindow(index, offset))
+					return FindResult::IOError;
+
+				auto *entS = (const FatDirent *)dataView;
+				auto max = WindowSize() / sizeof(*entS);
+
+				for (decltype(max) i = 0; i < max; ++i) {
+					if (entS[i].IsLastInList())
+						return FindResult::NoEntry;
+					if (entS[i].EntryFlags().IsSet(FatDirent::Flags::LongFileName))
+						continue;
+					if (entS[i].IsDummiedOut())
+						continue;
+
+					char buffer[8 + 1 + 3 + 1];
+					entS[i].NameToString(buffer);
+
+					if (StrEqual(buffer, name)) {
+						out.cluster = entS[i].ClusterIndex();
+						out.size = entS[i].Size();
+						out.flags = entS[i].EntryFlags();
+						return FindResult::Ok;
+					}
 				}
 			}
+
+			index = next;
 		}
 
 		return FindResult::NoEntry;
@@ -183,23 +336,88 @@ public:
 		return *_blk;
 	}
 private:
-	bool LoadDataCluster(uint32_t index) {
+	static constexpr size_t MaxRequests = 4;
+
+	// Upper limit for the data window, independent of the cluster size
+	static constexpr size_t MaxWindowSize = 4096;
+
+	static void RequestDone(BlockRequest &req) {
+		auto *fs = (FatFs *)req.context;
+
+		if (!req.success)
+			fs->requestFailed = true;
+
+		req.buffer = nullptr;
+		fs->inFlight -= 1;
+	}
+
+	bool SubmitClusters(uint32_t index, uint32_t count, uint8_t *buffer) {
+		if (index < 2) {
+			requestFailed = true;
+			return false;
+		}
+
+		auto depth = _blk->QueueDepth();
+		if (depth > MaxRequests)
+			depth = MaxRequests;
+
+		while (inFlight >= depth) {
+			if (_blk->Poll() == 0)
+				_blk->Wait();
+		}
+
+		BlockRequest *req = requests;
+		while (req->buffer != nullptr)
+			++req;
+
+		req->index = super.ClusterIndex2Sector(index);
+		req->count = count * super.SectorsPerCluster();
+		req->buffer = buffer;
+		req->completion = RequestDone;
+		req->context = this;
+
+		inFlight += 1;
+
+		if (!_blk->Submit(*req)) {
+			req->buffer = nullptr;
+			inFlight -= 1;
+			requestFailed = true;
+		}
+
+		return !requestFailed;
+	}
+
+	// Load the window of a cluster that contains the given byte offset
+	bool LoadDataWindow(uint32_t index, uint32_t offset) {
 		if (index < 2)
 			return false;
 
-		if (index == currentDataCluster)
+		auto lba = super.ClusterIndex2Sector(index) +
+			(offset / WindowSize()) * windowSectors;
+
+		if (lba == currentDataSector)
 			return true;
 
-		auto lba = super.ClusterIndex2Sector(index);
+		currentDataSector = 0xFFFFFFFF;
+
+		if (mapped) {
+			auto *ptr = _blk->MapSectors(lba, windowSectors);
+			if (ptr == nullptr)
+				return false;
+
+			dataView = (const uint8_t *)ptr;
+			currentDataSector = lba;
+			return true;
+		}
 
-		for (uint32_t i = 0; i < super.SectorsPerCluster(); ++i) {
+		for (uint32_t i = 0; i < windowSectors; ++i) {
 			auto *ptr = dataWindow + i * _blk->SectorSize();
 
 			if (!_blk->LoadSector(lba + i, ptr))
 				return false;
 		}
 
-		currentDataCluster = index;
+		currentDataSector = lba;
 		return true;
 	}
 
@@ -210,8 +428,15 @@ private:
 		if (index != currentFatSector) {
 			auto lba = super.ReservedSectors() + index;
 
-			if (!_blk->LoadSector(lba, fatWindow))
+			if (mapped) {
+				auto *ptr = _blk->MapSectors(lba, 1);
+				if (ptr == nullptr)
+					return false;
+
+				fatView = (const uint8_t *)ptr;
+			} else if (!_blk->LoadSector(lba, fatWindow)) {
 				return false;
+			}
 
 			currentFatSector = index;
 		}
@@ -225,16 +450,23 @@ private:
 		if (!LoadFatSector(sector))
 			return false;
 
-		out = *((uint32_t *)(fatWindow + offset));
+		out = *((const uint32_t *)(fatView + offset));
 		return true;
 	}
 
 	UniquePtr<IBlockDevice> _blk;
 	uint8_t *fatWindow;
 	uint8_t *dataWindow;
+	const uint8_t *fatView;
+	const uint8_t *dataView;
 	const FatSuper &super;
 	uint32_t currentFatSector;
-	uint32_t currentDataCluster;
+	uint32_t currentDataSector;
+	uint32_t windowSectors;
+	BlockRequest requests[MaxRequests];
+	size_t inFlight;
+	bool requestFailed;
+	bool mapped;
 };
 
 #endif /* FAT_FS_H */
@@ -85,6 +85,10 @@ public:
 		return _rootDirIndex.Read();
 	}
 
+	bool HasBootSignature() const {
+		return _bootSignature.Read() == 0xAA55;
+	}
+
 	uint32_t ClusterIndex2Sector(uint32_t N) const {
 		auto first = ReservedSectors() + NumFats() * SectorsPerFat();
 
@@ -0,0 +1,91 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * Crc32c.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <cstdint>
+#include <cstddef>
+
+/*
+  CRC-32C (Castagnoli), slice-by-8. The tables are generated by the
+  constructor and make the object 8k large, so it should not be put
+  on the stack.
+*/
+class Crc32c {
+public:
+	static constexpr size_t DigestSize = 4;
+
+	Crc32c() {
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t crc = i;
+
+			for (int j = 0; j < 8; ++j)
+				crc = (crc >> 1) ^ ((crc & 1) ? Polynomial : 0);
+
+			_table[0][i] = crc;
+		}
+
+		for (uint32_t i = 0; i < 256; ++i) {
+			for (int j = 1; j < 8; ++j) {
+				auto prev = _table[j - 1][i];
+
+				_table[j][i] = (prev >> 8) ^
+					_table[0][prev & 0xFF];
+			}
+		}
+
+		Reset();
+	}
+
+	void Reset() {
+		_crc = 0xFFFFFFFF;
+	}
+
+	void Update(const void *data, size_t size) {
+		auto *ptr = (const uint8_t *)data;
+		auto crc = _crc;
+
+		while (size > 0 && ((uintptr_t)ptr & 0x03) != 0) {
+			crc = _table[0][(crc ^ *(ptr++)) & 0xFF] ^ (crc >> 8);
+			--size;
+		}
+
+		for (; size >= 8; size -= 8, ptr += 8) {
+			auto lo = ((const uint32_t *)ptr)[0] ^ crc;
+			auto hi = ((const uint32_t *)ptr)[1];
+
+			crc = _table[7][lo & 0xFF] ^
+				_table[6][(lo >> 8) & 0xFF] ^
+				_table[5][(lo >> 16) & 0xFF] ^
+				_table[4][lo >> 24] ^
+				_table[3][hi & 0xFF] ^
+				_table[2][(hi >> 8) & 0xFF] ^
+				_table[1][(hi >> 16) & 0xFF] ^
+				_table[0][hi >> 24];
+		}
+
+		while (size-- > 0)
+			crc = _table[0][(crc ^ *(ptr++)) & 0xFF] ^ (crc >> 8);
+
+		_crc = crc;
+	}
+
+	// The digest is stored big endian, i.e. in the order it is printed
+	void Finalize(uint8_t *digest) const {
+		auto crc = ~_crc;
+
+		for (size_t i = 0; i < DigestSize; ++i)
+			digest[i] = crc >> (24 - 8 * i);
+	}
+private:
+	static constexpr uint32_t Polynomial = 0x82F63B78;
+
+	uint32_t _table[8][256];
+	uint32_t _crc;
+};
+
+#endif /* CRC32C_H */
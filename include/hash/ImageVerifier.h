@@ -0,0 +1,135 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * ImageVerifier.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef IMAGE_VERIFIER_H
+#define IMAGE_VERIFIER_H
+
+#include "hash/Crc32c.h"
+#include "hash/Sha256.h"
+#include "StringUtil.h"
+#include "Memory.h"
+
+/*
+  Checks an image against an expected digest, while it is being loaded.
+  The expectation is armed with Expect() and consumed by the next
+  Begin()/Update()/End() sequence. Without it, those do nothing.
+
+  A zero initialized object is valid, so it can be a static in stage2.
+*/
+class ImageVerifier {
+public:
+	// Parses "<crc32c|sha256> <hex digest>"
+	bool Expect(const char *arg) {
+		const char *name = arg;
+		size_t size;
+
+		while (IsAlnum(*arg))
+			++arg;
+
+		if (MatchWord(name, arg, "crc32c")) {
+			_type = HashType::CRC32C;
+			size = Crc32c::DigestSize;
+		} else if (MatchWord(name, arg, "sha256")) {
+			_type = HashType::SHA256;
+			size = Sha256::DigestSize;
+		} else {
+			return false;
+		}
+
+		while (IsSpace(*arg))
+			++arg;
+
+		for (size_t i = 0; i < size; ++i) {
+			int hi = HexDigit(arg[2 * i]);
+			int lo = hi < 0 ? -1 : HexDigit(arg[2 * i + 1]);
+
+			if (lo < 0) {
+				_type = HashType::None;
+				return false;
+			}
+
+			_digest[i] = (hi << 4) | lo;
+		}
+
+		// nothing but white space after the digest
+		arg += 2 * size;
+
+		while (IsSpace(*arg) || *arg == '\r')
+			++arg;
+
+		if (*arg != '\0') {
+			_type = HashType::None;
+			return false;
+		}
+
+		return true;
+	}
+
+	// Returns false if out of memory
+	bool Begin() {
+		if (_type == HashType::CRC32C)
+			_crc = new Crc32c();
+		if (_type == HashType::SHA256)
+			_sha = new Sha256();
+
+		return _type == HashType::None || _crc != nullptr ||
+			_sha != nullptr;
+	}
+
+	void Update(const void *data, size_t size) {
+		if (_crc != nullptr)
+			_crc->Update(data, size);
+		if (_sha != nullptr)
+			_sha->Update(data, size);
+	}
+
+	// Returns false on a mismatch
+	bool End() {
+		uint8_t digest[Sha256::DigestSize];
+		size_t digestSize = 0;
+		bool match = true;
+
+		if (_crc != nullptr) {
+			_crc->Finalize(digest);
+			digestSize = Crc32c::DigestSize;
+		}
+
+		if (_sha != nullptr) {
+			_sha->Finalize(digest);
+			digestSize = Sha256::DigestSize;
+		}
+
+		for (size_t i = 0; i < digestSize; ++i) {
+			if (digest[i] != _digest[i])
+				match = false;
+		}
+
+		Cancel();
+		return match;
+	}
+
+	// Drops the expected digest, e.g. if the image was never loaded
+	void Cancel() {
+		delete _crc;
+		delete _sha;
+		_crc = nullptr;
+		_sha = nullptr;
+		_type = HashType::None;
+	}
+private:
+	enum class HashType {
+		None = 0,
+		CRC32C,
+		SHA256,
+	};
+
+	HashType _type;
+	uint8_t _digest[Sha256::DigestSize];
+	Crc32c *_crc;
+	Sha256 *_sha;
+};
+
+#endif /* IMAGE_VERIFIER_H */
@@ -0,0 +1,158 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * Sha256.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <cstdint>
+#include <cstddef>
+
+class Sha256 {
+public:
+	static constexpr size_t DigestSize = 32;
+
+	Sha256() {
+		Reset();
+	}
+
+	void Reset() {
+		_state[0] = 0x6a09e667;
+		_state[1] = 0xbb67ae85;
+		_state[2] = 0x3c6ef372;
+		_state[3] = 0xa54ff53a;
+		_state[4] = 0x510e527f;
+		_state[5] = 0x9b05688c;
+		_state[6] = 0x1f83d9ab;
+		_state[7] = 0x5be0cd19;
+		_total = 0;
+		_used = 0;
+	}
+
+	void Update(const void *data, size_t size) {
+		auto *ptr = (const uint8_t *)data;
+
+		_total += size;
+
+		if (_used > 0) {
+			while (size > 0 && _used < BlockSize) {
+				_block[_used++] = *(ptr++);
+				--size;
+			}
+
+			if (_used < BlockSize)
+				return;
+
+			Compress(_block);
+			_used = 0;
+		}
+
+		// whole blocks are processed in place
+		for (; size >= BlockSize; size -= BlockSize, ptr += BlockSize)
+			Compress(ptr);
+
+		while (size-- > 0)
+			_block[_used++] = *(ptr++);
+	}
+
+	void Finalize(uint8_t *digest) {
+		uint64_t bits = _total * 8;
+
+		_block[_used++] = 0x80;
+
+		if (_used > BlockSize - 8) {
+			while (_used < BlockSize)
+				_block[_used++] = 0;
+
+			Compress(_block);
+			_used = 0;
+		}
+
+		while (_used < BlockSize - 8)
+			_block[_used++] = 0;
+
+		for (int i = 0; i < 8; ++i)
+			_block[_used++] = bits >> (56 - 8 * i);
+
+		Compress(_block);
+
+		for (size_t i = 0; i < DigestSize; ++i)
+			digest[i] = _state[i / 4] >> (24 - 8 * (i % 4));
+	}
+private:
+	static constexpr size_t BlockSize = 64;
+
+	static uint32_t Ror(uint32_t x, int n) {
+		return (x >> n) | (x << (32 - n));
+	}
+
+	void Compress(const uint8_t *in) {
+		static constexpr uint32_t k[64] = {
+			0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+			0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+			0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+			0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+			0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+			0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+			0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+			0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+			0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+			0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+			0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+			0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+			0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+			0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+			0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+			0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+		};
+		uint32_t w[64], s[8];
+
+		for (int i = 0; i < 16; ++i) {
+			w[i] = ((uint32_t)in[4 * i] << 24) |
+				((uint32_t)in[4 * i + 1] << 16) |
+				((uint32_t)in[4 * i + 2] << 8) |
+				(uint32_t)in[4 * i + 3];
+		}
+
+		for (int i = 16; i < 64; ++i) {
+			auto s0 = Ror(w[i - 15], 7) ^ Ror(w[i - 15], 18) ^
+				(w[i - 15] >> 3);
+			auto s1 = Ror(w[i - 2], 17) ^ Ror(w[i - 2], 19) ^
+				(w[i - 2] >> 10);
+
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+
+		for (int i = 0; i < 8; ++i)
+			s[i] = _state[i];
+
+		for (int i = 0; i < 64; ++i) {
+			auto S1 = Ror(s[4], 6) ^ Ror(s[4], 11) ^ Ror(s[4], 25);
+			auto ch = (s[4] & s[5]) ^ (~s[4] & s[6]);
+			auto t1 = s[7] + S1 + ch + k[i] + w[i];
+			auto S0 = Ror(s[0], 2) ^ Ror(s[0], 13) ^ Ror(s[0], 22);
+			auto maj = (s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]);
+
+			s[7] = s[6];
+			s[6] = s[5];
+			s[5] = s[4];
+			s[4] = s[3] + t1;
+			s[3] = s[2];
+			s[2] = s[1];
+			s[1] = s[0];
+			s[0] = t1 + S0 + maj;
+		}
+
+		for (int i = 0; i < 8; ++i)
+			_state[i] += s[i];
+	}
+
+	uint32_t _state[8];
+	uint64_t _total;
+	size_t _used;
+	uint8_t _block[BlockSize];
+};
+
+#endif /* SHA256_H */
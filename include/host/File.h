@@ -9,6 +9,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 class File {
 public:
@@ -89,6 +90,15 @@ public:
 
 		return total;
 	}
+
+	uint64_t Size() const {
+		struct stat sb;
+
+		if (fstat(_fd, &sb) != 0)
+			HandleError(-1, errno);
+
+		return sb.st_size;
+	}
 private:
 	void HandleError(ssize_t retCode, int errorCode) const {
 		if (retCode < 0) {
@@ -0,0 +1,228 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * Acpi.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "types/UnalignedInt.h"
+#include "kernel/BiosDataArea.h"
+
+/*
+  Just enough ACPI table parsing to find the processors.
+
+  All tables are accessed through the identity mapping. The firmware has to
+  place them in memory that the E820 map reports as reserved or ACPI
+  memory, which the kernel maps, and only tables below 4G are considered.
+*/
+static inline bool AcpiChecksumOk(const void *data, size_t size)
+{
+	const auto *ptr = (const uint8_t *)data;
+	uint8_t sum = 0;
+
+	while (size--)
+		sum += *(ptr++);
+
+	return sum == 0;
+}
+
+// Common header of all system description tables
+class AcpiSdt {
+public:
+	bool HasSignature(const char *sig) const {
+		for (size_t i = 0; i < sizeof(_signature); ++i) {
+			if (_signature[i] != sig[i])
+				return false;
+		}
+		return true;
+	}
+
+	uint32_t Length() const {
+		return _length.Read();
+	}
+
+	bool IsValid() const {
+		return Length() >= sizeof(*this) &&
+			AcpiChecksumOk(this, Length());
+	}
+
+	const uint8_t *Data() const {
+		return (const uint8_t *)(this + 1);
+	}
+
+	uint32_t DataLength() const {
+		return Length() - sizeof(*this);
+	}
+private:
+	char _signature[4];
+	UnalignedInt<uint32_t> _length;
+	uint8_t _revision;
+	uint8_t _checksum;
+	char _oemId[6];
+	char _oemTableId[8];
+	UnalignedInt<uint32_t> _oemRevision;
+	UnalignedInt<uint32_t> _creatorId;
+	UnalignedInt<uint32_t> _creatorRevision;
+};
+
+static_assert(sizeof(AcpiSdt) == 36);
+
+// Root system description pointer
+class AcpiRsdp {
+public:
+	// Searches the first KiB of the EBDA, then the BIOS ROM area
+	static const AcpiRsdp *Find() {
+		uintptr_t ebda = BiosDataWord(BdaEbdaSegment) << 4;
+
+		if (ebda != 0 && ebda < 0xA0000) {
+			auto *ret = Scan(ebda, ebda + 1024);
+			if (ret != nullptr)
+				return ret;
+		}
+
+		return Scan(0xE0000, 0x100000);
+	}
+
+	// Returns the first valid table with a signature
+	const AcpiSdt *FindTable(const char *sig) const {
+		uint64_t xsdt = _xsdtAddress.Read();
+		const AcpiSdt *root;
+		size_t entrySize;
+
+		if (_revision >= 2 && xsdt != 0 && xsdt < 0x1'0000'0000) {
+			root = (const AcpiSdt *)(uintptr_t)xsdt;
+			entrySize = sizeof(uint64_t);
+		} else {
+			root = (const AcpiSdt *)(uintptr_t)_rsdtAddress.Read();
+			entrySize = sizeof(uint32_t);
+		}
+
+		if (root == nullptr || !root->IsValid())
+			return nullptr;
+
+		for (size_t i = 0; i + entrySize <= root->DataLength();
+		     i += entrySize) {
+			uint64_t addr;
+
+			if (entrySize == sizeof(uint64_t)) {
+				addr = ((const UnalignedInt<uint64_t> *)
+					(root->Data() + i))->Read();
+			} else {
+				addr = ((const UnalignedInt<uint32_t> *)
+					(root->Data() + i))->Read();
+			}
+
+			if (addr == 0 || addr >= 0x1'0000'0000)
+				continue;
+
+			auto *sdt = (const AcpiSdt *)(uintptr_t)addr;
+
+			if (sdt->HasSignature(sig) && sdt->IsValid())
+				return sdt;
+		}
+
+		return nullptr;
+	}
+private:
+	static const AcpiRsdp *Scan(uintptr_t start, uintptr_t end) {
+		for (; start < end; start += 16) {
+			auto *rsdp = (const AcpiRsdp *)start;
+
+			if (rsdp->IsValid())
+				return rsdp;
+		}
+
+		return nullptr;
+	}
+
+	bool IsValid() const {
+		static const char sig[] = "RSD PTR ";
+
+		for (size_t i = 0; i < sizeof(_signature); ++i) {
+			if (_signature[i] != sig[i])
+				return false;
+		}
+
+		// version 1 only has the first 20 bytes
+		return AcpiChecksumOk(this, 20);
+	}
+
+	char _signature[8];
+	uint8_t _checksum;
+	char _oemId[6];
+	uint8_t _revision;
+	UnalignedInt<uint32_t> _rsdtAddress;
+	UnalignedInt<uint32_t> _length;
+	UnalignedInt<uint64_t> _xsdtAddress;
+	uint8_t _extChecksum;
+	uint8_t _reserved[3];
+};
+
+static_assert(sizeof(AcpiRsdp) == 36);
+
+// Multiple APIC description table, signature "APIC"
+class AcpiMadt {
+public:
+	explicit AcpiMadt(const AcpiSdt *sdt) : _sdt(sdt) {
+	}
+
+	// Default address, unless there is a 64 bit override entry
+	uint64_t LocalApicAddress() const {
+		uint64_t addr = Read<uint32_t>(_sdt->Data());
+
+		ForEachEntry([&](uint8_t type, const uint8_t *ent, uint8_t len) {
+			if (type == EntryLocalApicOverride && len >= 12)
+				addr = Read<uint64_t>(ent + 4);
+		});
+
+		return addr;
+	}
+
+	// Calls fn(apicId) for each enabled processor local APIC
+	template<typename F>
+	void ForEachCpu(F fn) const {
+		ForEachEntry([&](uint8_t type, const uint8_t *ent, uint8_t len) {
+			if (type != EntryLocalApic || len < 8)
+				return;
+
+			if (Read<uint32_t>(ent + 4) & FlagEnabled)
+				fn(ent[3]);
+		});
+	}
+private:
+	static constexpr uint8_t EntryLocalApic = 0;
+	static constexpr uint8_t EntryLocalApicOverride = 5;
+	static constexpr uint32_t FlagEnabled = 0x01;
+
+	template<typename T>
+	static T Read(const uint8_t *ptr) {
+		return ((const UnalignedInt<T> *)ptr)->Read();
+	}
+
+	// entries follow the local APIC address and a flags field
+	template<typename F>
+	void ForEachEntry(F fn) const {
+		auto *data = _sdt->Data();
+		size_t size = _sdt->DataLength();
+
+		for (size_t i = 8; (i + 2) <= size; ) {
+			uint8_t type = data[i];
+			uint8_t len = data[i + 1];
+
+			if (len < 2 || (i + len) > size)
+				break;
+
+			fn(type, data + i, len);
+			i += len;
+		}
+	}
+
+	const AcpiSdt *_sdt;
+};
+
+#endif /* ACPI_H */
@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * Atomic.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+#include <cstdint>
+
+/*
+  Read-modify-write operations for the kernel. With -march=i386, GCC turns
+  the __atomic builtins for these into libatomic calls, because the 386
+  lacks CMPXCHG and XADD. Anything with more than one CPU has them, so they
+  are used directly. Plain loads and stores can still use the builtins.
+*/
+static inline bool AtomicCompareExchange(volatile uint32_t *ptr,
+					 uint32_t expected, uint32_t desired)
+{
+	bool ret;
+
+	__asm__ __volatile__("lock cmpxchgl %3, %1\n\t"
+			     "sete %0"
+			     : "=q"(ret), "+m"(*ptr), "+a"(expected)
+			     : "r"(desired)
+			     : "memory", "cc");
+	return ret;
+}
+
+static inline uint32_t AtomicFetchAdd(volatile uint32_t *ptr, uint32_t value)
+{
+	__asm__ __volatile__("lock xaddl %0, %1"
+			     : "+r"(value), "+m"(*ptr)
+			     : : "memory", "cc");
+	return value;
+}
+
+// Full barrier, i.e. also orders stores before later loads
+static inline void AtomicFence()
+{
+	__asm__ __volatile__("lock orl $0, (%%esp)" : : : "memory", "cc");
+}
+
+static inline void CpuRelax()
+{
+	__asm__ __volatile__("pause" : : : "memory");
+}
+
+#endif /* ATOMIC_H */
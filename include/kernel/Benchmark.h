@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * Benchmark.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "kernel/Cpu.h"
+#include "device/Pit.h"
+
+/*
+  In-kernel micro benchmarks, timed with the TSC.
+
+  A benchmark is a function that performs an operation "count" times. It
+  is registered with KERNEL_BENCHMARK, which drops a descriptor into the
+  .benchmarks section, collected by kernel.ld. Every sample times one call
+  with "batch" operations, after "warmup" calls that are not recorded.
+
+  Results are reported in TSC ticks per operation, together with the TSC
+  frequency measured against the PIT, so a host side script can turn them
+  into time. The kernel has no 64 bit division (no libgcc), so neither does
+  this.
+*/
+struct Benchmark {
+	const char *name;
+	void (*run)(uint32_t count);
+	uint32_t batch;
+	uint32_t warmup;
+	uint32_t samples;
+};
+
+#define KERNEL_BENCHMARK(id, fn, batch, warmup, samples)		\
+	[[gnu::used, gnu::section(".benchmarks")]]			\
+	static const Benchmark benchmark_##id = {			\
+		#id, fn, batch, warmup, samples				\
+	}
+
+extern "C" {
+	// kernel.ld
+	extern const Benchmark __start_benchmarks[];
+	extern const Benchmark __stop_benchmarks[];
+};
+
+class BenchmarkRunner {
+public:
+	static constexpr size_t MaxSamples = 256;
+
+	struct Result {
+		uint32_t min;
+		uint32_t median;
+		uint32_t p99;
+		uint32_t samples;
+	};
+
+	// TSC ticks per millisecond, the best of a few 10ms PIT delays
+	bool Calibrate() {
+		_tscKHz = 0;
+
+		for (int i = 0; i < 3; ++i) {
+			auto start = ReadTsc();
+			PitDelay(10000);
+			auto ticks = (uint32_t)(ReadTsc() - start) / 10;
+
+			if (_tscKHz == 0 || ticks < _tscKHz)
+				_tscKHz = ticks;
+		}
+
+		return _tscKHz > 0;
+	}
+
+	uint32_t TscKHz() const {
+		return _tscKHz;
+	}
+
+	Result Run(const Benchmark &bench) {
+		uint32_t count = bench.samples;
+		uint32_t batch = bench.batch > 0 ? bench.batch : 1;
+
+		if (count > MaxSamples)
+			count = MaxSamples;
+		if (count == 0)
+			count = 1;
+
+		for (uint32_t i = 0; i < bench.warmup; ++i)
+			bench.run(batch);
+
+		for (uint32_t i = 0; i < count; ++i) {
+			auto start = ReadTsc();
+			bench.run(batch);
+			auto ticks = ReadTsc() - start;
+
+			_samples[i] = ticks > 0xFFFFFFFF ? 0xFFFFFFFF :
+				(uint32_t)ticks / batch;
+		}
+
+		// insertion sort, there are only a few hundred
+		for (uint32_t i = 1; i < count; ++i) {
+			auto x = _samples[i];
+			auto j = i;
+
+			for (; j > 0 && _samples[j - 1] > x; --j)
+				_samples[j] = _samples[j - 1];
+
+			_samples[j] = x;
+		}
+
+		return Result{_samples[0], _samples[count / 2],
+			      _samples[(count * 99) / 100], count};
+	}
+
+	/*
+	  Runs all registered benchmarks and writes one line per benchmark:
+	    @tsc <kHz>
+	    @bench <name> <batch> <samples> <min> <median> <p99>
+	*/
+	template<class OUT>
+	void RunAll(OUT &out) {
+		out << "@tsc " << _tscKHz << "\r\n";
+
+		for (auto *b = __start_benchmarks; b < __stop_benchmarks; ++b) {
+			auto res = Run(*b);
+
+			out << "@bench " << b->name << " " << b->batch << " "
+			    << res.samples << " " << res.min << " "
+			    << res.median << " " << res.p99 << "\r\n";
+		}
+	}
+private:
+	uint32_t _samples[MaxSamples]{};
+	uint32_t _tscKHz = 0;
+};
+
+#endif /* BENCHMARK_H */
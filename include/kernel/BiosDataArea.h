@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * BiosDataArea.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef BIOS_DATA_AREA_H
+#define BIOS_DATA_AREA_H
+
+#include <cstdint>
+
+static constexpr uint16_t BdaEbdaSegment = 0x0E;
+static constexpr uint16_t BdaBaseMemoryKiB = 0x13;
+
+// Reads a word from the BIOS data area at 0x400, through the identity map
+static inline uint16_t BiosDataWord(uint16_t offset)
+{
+	uintptr_t addr = 0x400 + offset;
+
+	// GCC considers anything in the first 4k a null pointer dereference
+	__asm__("" : "+r"(addr));
+
+	return *((const volatile uint16_t *)addr);
+}
+
+#endif /* BIOS_DATA_AREA_H */
@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * CacheControl.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef CACHE_CONTROL_H
+#define CACHE_CONTROL_H
+
+#include <cstdint>
+
+#include "kernel/PageDirectory.h"
+#include "kernel/Cpu.h"
+
+/*
+  Write combining for video memory.
+
+  The firmware leaves VRAM uncached, so every store is a separate bus
+  transaction. Write combining collects them in a buffer and writes whole
+  lines, which is a lot faster for memory that is only ever written to.
+
+  With PAT, entry 1 (selected by PWT alone) is changed from write through
+  to write combining, and VRAM is mapped with that. Nothing else uses PWT
+  without PCD. Before PAT (Pentium Pro/II), the fixed range MTRR that
+  covers the text mode buffer at 0xB8000 is changed instead.
+
+  Both PAT and the MTRRs are per CPU and must be the same everywhere, so
+  SetupCpu has to run on every CPU.
+*/
+class CacheControl {
+public:
+	enum class Method {
+		None,
+		Pat,
+		Mtrr,
+	};
+
+	static constexpr PageDirectory::Flag WriteCombining =
+		PageDirectory::Flag::WriteThrough;
+
+	// On the boot CPU
+	void Init(const CpuId &cpu) {
+		_method = Method::None;
+
+		if (!cpu.Has(CpuId::Feature::MSR))
+			return;
+
+		if (cpu.Has(CpuId::Feature::PAT)) {
+			_method = Method::Pat;
+		} else if (cpu.Has(CpuId::Feature::MTRR)) {
+			auto cap = ReadMsr(MsrMtrrCap);
+			auto def = ReadMsr(MsrMtrrDefType);
+
+			// needs fixed ranges, enabled, and the WC type
+			if ((cap & 0x500) == 0x500 && (def & 0xC00) == 0xC00)
+				_method = Method::Mtrr;
+		}
+	}
+
+	Method Type() const {
+		return _method;
+	}
+
+	// Whether page tables have to use the WriteCombining flag
+	bool NeedsMapping() const {
+		return _method == Method::Pat;
+	}
+
+	void SetupCpu() {
+		if (_method == Method::Pat) {
+			auto pat = ReadMsr(MsrPat);
+
+			pat = (pat & ~0xFF00ULL) | ((uint64_t)TypeWc << 8);
+			WriteMsr(MsrPat, pat);
+
+			// drop cache lines and TLB entries of the old type
+			__asm__ __volatile__("wbinvd" : : : "memory");
+			if (ReadCr0() & Cr0PagingEnable)
+				WriteCr3(ReadCr3());
+		} else if (_method == Method::Mtrr) {
+			SetTextModeMtrr();
+		}
+	}
+private:
+	static constexpr uint32_t MsrMtrrCap = 0x0FE;
+	static constexpr uint32_t MsrMtrrFix16kA0000 = 0x259;
+	static constexpr uint32_t MsrPat = 0x277;
+	static constexpr uint32_t MsrMtrrDefType = 0x2FF;
+	static constexpr uint8_t TypeWc = 0x01;
+
+	// the procedure from the Intel SDM, with caches disabled meanwhile
+	static void SetTextModeMtrr() {
+		auto cr0 = ReadCr0();
+
+		WriteCr0((cr0 | Cr0CacheDisable) & ~Cr0NotWriteThrough);
+		__asm__ __volatile__("wbinvd" : : : "memory");
+
+		auto def = ReadMsr(MsrMtrrDefType);
+		WriteMsr(MsrMtrrDefType, def & ~0x800ULL);
+
+		// one byte per 16k, 0xB8000-0xBFFFF are the last two
+		auto fix = ReadMsr(MsrMtrrFix16kA0000);
+
+		fix &= 0x0000FFFFFFFFFFFFULL;
+		fix |= ((uint64_t)TypeWc << 48) | ((uint64_t)TypeWc << 56);
+		WriteMsr(MsrMtrrFix16kA0000, fix);
+
+		WriteMsr(MsrMtrrDefType, def);
+		__asm__ __volatile__("wbinvd" : : : "memory");
+		WriteCr0(cr0);
+	}
+
+	Method _method = Method::None;
+};
+
+#endif /* CACHE_CONTROL_H */
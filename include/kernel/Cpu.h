@@ -0,0 +1,188 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * Cpu.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef CPU_H
+#define CPU_H
+
+#include <cstdint>
+
+class CpuId {
+public:
+	// CPUID leaf 1, EDX
+	enum class Feature : uint32_t {
+		FPU = 0x00000001,
+		PSE = 0x00000008,
+		TSC = 0x00000010,
+		MSR = 0x00000020,
+		PAE = 0x00000040,
+		APIC = 0x00000200,
+		MTRR = 0x00001000,
+		PGE = 0x00002000,
+		PAT = 0x00010000,
+		MMX = 0x00800000,
+		FXSR = 0x01000000,
+		SSE = 0x02000000,
+		SSE2 = 0x04000000,
+	};
+
+	// CPUID leaf 1, ECX
+	enum class FeatureEcx : uint32_t {
+		SSE3 = 0x00000001,
+		Monitor = 0x00000008,
+	};
+
+	// CPUID leaf 7, sub leaf 0, EBX
+	enum class FeatureExt : uint32_t {
+		ERMSB = 0x00000200,
+	};
+
+	// The instruction only exists if the ID flag in EFLAGS can be toggled
+	static bool Supported() {
+		uint32_t a, b;
+
+		__asm__ __volatile__("pushfl\n\t"
+				     "pushfl\n\t"
+				     "popl %0\n\t"
+				     "movl %0, %1\n\t"
+				     "xorl $0x00200000, %0\n\t"
+				     "pushl %0\n\t"
+				     "popfl\n\t"
+				     "pushfl\n\t"
+				     "popl %0\n\t"
+				     "popfl"
+				     : "=&r"(a), "=&r"(b) : : "cc");
+
+		return ((a ^ b) & 0x00200000) != 0;
+	}
+
+	static void Query(uint32_t leaf, uint32_t subLeaf, uint32_t regs[4]) {
+		__asm__ __volatile__("cpuid"
+				     : "=a"(regs[0]), "=b"(regs[1]),
+				       "=c"(regs[2]), "=d"(regs[3])
+				     : "a"(leaf), "c"(subLeaf));
+	}
+
+	void Load() {
+		uint32_t regs[4];
+
+		if (!Supported())
+			return;
+
+		Query(0, 0, regs);
+		_maxLeaf = regs[0];
+
+		if (_maxLeaf >= 1) {
+			Query(1, 0, regs);
+			_signature = regs[0];
+			_featuresEcx = regs[2];
+			_features = regs[3];
+		}
+
+		if (_maxLeaf >= 7) {
+			Query(7, 0, regs);
+			_featuresExt = regs[1];
+		}
+	}
+
+	bool Has(Feature f) const {
+		return (_features & (uint32_t)f) != 0;
+	}
+
+	bool Has(FeatureEcx f) const {
+		return (_featuresEcx & (uint32_t)f) != 0;
+	}
+
+	bool Has(FeatureExt f) const {
+		return (_featuresExt & (uint32_t)f) != 0;
+	}
+
+	uint32_t MaxLeaf() const {
+		return _maxLeaf;
+	}
+
+	uint32_t Signature() const {
+		return _signature;
+	}
+private:
+	uint32_t _maxLeaf = 0;
+	uint32_t _signature = 0;
+	uint32_t _features = 0;
+	uint32_t _featuresEcx = 0;
+	uint32_t _featuresExt = 0;
+};
+
+static constexpr uint32_t Cr0MonitorCoproc = 0x00000002;
+static constexpr uint32_t Cr0Emulation = 0x00000004;
+static constexpr uint32_t Cr0NotWriteThrough = 0x20000000;
+static constexpr uint32_t Cr0CacheDisable = 0x40000000;
+static constexpr uint32_t Cr0PagingEnable = 0x80000000;
+static constexpr uint32_t Cr4PageSizeExt = 0x00000010;
+static constexpr uint32_t Cr4OsFxsr = 0x00000200;
+
+static inline uint32_t ReadCr0()
+{
+	uint32_t ret;
+	__asm__ __volatile__("movl %%cr0, %0" : "=r"(ret));
+	return ret;
+}
+
+static inline void WriteCr0(uint32_t value)
+{
+	__asm__ __volatile__("movl %0, %%cr0" : : "r"(value) : "memory");
+}
+
+static inline uint32_t ReadCr3()
+{
+	uint32_t ret;
+	__asm__ __volatile__("movl %%cr3, %0" : "=r"(ret));
+	return ret;
+}
+
+static inline void WriteCr3(uint32_t value)
+{
+	__asm__ __volatile__("movl %0, %%cr3" : : "r"(value) : "memory");
+}
+
+// Does not exist before the Pentium, only use if CPUID is available
+static inline uint32_t ReadCr4()
+{
+	uint32_t ret;
+	__asm__ __volatile__("movl %%cr4, %0" : "=r"(ret));
+	return ret;
+}
+
+static inline void WriteCr4(uint32_t value)
+{
+	__asm__ __volatile__("movl %0, %%cr4" : : "r"(value) : "memory");
+}
+
+// Only if CPUID reports MSR support
+static inline uint64_t ReadMsr(uint32_t index)
+{
+	uint32_t lo, hi;
+
+	__asm__ __volatile__("rdmsr" : "=a"(lo), "=d"(hi) : "c"(index));
+	return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void WriteMsr(uint32_t index, uint64_t value)
+{
+	__asm__ __volatile__("wrmsr"
+			     : : "c"(index), "a"((uint32_t)value),
+			       "d"((uint32_t)(value >> 32))
+			     : "memory");
+}
+
+// Only if CPUID reports a TSC
+static inline uint64_t ReadTsc()
+{
+	uint32_t lo, hi;
+
+	__asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32) | lo;
+}
+
+#endif /* CPU_H */
@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * Idt.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef IDT_H
+#define IDT_H
+
+#include <cstdint>
+#include <cstddef>
+
+/*
+  Interrupt descriptor table with 32 bit interrupt gates, i.e. interrupts
+  are disabled while a handler runs. A single table is shared by all CPUs,
+  each of them has to load it.
+*/
+class Idt {
+public:
+	static constexpr size_t Count = 256;
+
+	void SetGate(uint8_t vector, void (*handler)(),
+		     uint16_t selector = 0x08) {
+		auto addr = (uintptr_t)handler;
+
+		_gates[vector] = (addr & 0xFFFFULL) |
+			((uint64_t)selector << 16) |
+			((uint64_t)0x8E << 40) |
+			((uint64_t)(addr >> 16) << 48);
+	}
+
+	void Load() const {
+		struct __attribute__((packed)) {
+			uint16_t limit;
+			uint32_t base;
+		} desc = { sizeof(_gates) - 1, (uint32_t)_gates };
+
+		__asm__ __volatile__("lidt %0" : : "m"(desc));
+	}
+private:
+	uint64_t _gates[Count]{};
+};
+
+#endif /* IDT_H */
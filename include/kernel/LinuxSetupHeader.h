@@ -0,0 +1,124 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * LinuxSetupHeader.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef LINUX_SETUP_HEADER_H
+#define LINUX_SETUP_HEADER_H
+
+#include "types/UnalignedInt.h"
+#include "types/ByteBlob.h"
+
+#include <cstdint>
+
+/*
+  The setup header of an x86 Linux kernel image, as described in the
+  kernel's Documentation/arch/x86/boot.rst. It sits at a fixed offset
+  in the real-mode part of the image.
+*/
+class LinuxSetupHeader {
+public:
+	static constexpr uint32_t Offset = 0x1F1;
+	static constexpr uint32_t Magic = 0x53726448; // "HdrS"
+
+	enum class LoadFlags : uint8_t {
+		LoadedHigh = 0x01,
+		CanUseHeap = 0x80,
+	};
+
+	// bzImage with a command line pointer, i.e. protocol 2.02 or later
+	bool IsValid() const {
+		return _bootFlag.Read() == 0xAA55 && _header.Read() == Magic &&
+			_version.Read() >= 0x0202 &&
+			(_loadFlags & (uint8_t)LoadFlags::LoadedHigh) != 0;
+	}
+
+	uint16_t Version() const {
+		return _version.Read();
+	}
+
+	// size of the real-mode part, including the boot sector
+	uint32_t SetupSize() const {
+		auto sects = _setupSects == 0 ? 4 : _setupSects;
+
+		return (sects + 1) * 512;
+	}
+
+	uint32_t Code32Start() const {
+		return _code32Start.Read();
+	}
+
+	uint32_t InitrdAddrMax() const {
+		return _version.Read() >= 0x0203 ?
+			_initrdAddrMax.Read() : 0x37FFFFFF;
+	}
+
+	// maximum command line length, without the terminator
+	uint32_t CmdLineSize() const {
+		return _version.Read() >= 0x0206 ? _cmdLineSize.Read() : 255;
+	}
+
+	// memory the kernel needs at its load address, while decompressing
+	uint32_t InitSize() const {
+		return _version.Read() >= 0x020A ? _initSize.Read() : 0;
+	}
+
+	void SetLoader(uint16_t heapEnd) {
+		_typeOfLoader = 0xFF;
+		_loadFlags |= (uint8_t)LoadFlags::CanUseHeap;
+		_heapEndPtr = heapEnd - 0x200;
+	}
+
+	void SetCmdLine(uint32_t address) {
+		_cmdLinePtr = address;
+	}
+
+	void SetRamdisk(uint32_t address, uint32_t size) {
+		_ramdiskImage = address;
+		_ramdiskSize = size;
+	}
+private:
+	uint8_t _setupSects;
+	UnalignedInt<uint16_t> _rootFlags;
+	UnalignedInt<uint32_t> _sysSize;
+	UnalignedInt<uint16_t> _ramSize;
+	UnalignedInt<uint16_t> _vidMode;
+	UnalignedInt<uint16_t> _rootDev;
+	UnalignedInt<uint16_t> _bootFlag;
+	UnalignedInt<uint16_t> _jump;
+	UnalignedInt<uint32_t> _header;
+	UnalignedInt<uint16_t> _version;
+	UnalignedInt<uint32_t> _realModeSwitch;
+	UnalignedInt<uint16_t> _startSysSeg;
+	UnalignedInt<uint16_t> _kernelVersion;
+	uint8_t _typeOfLoader;
+	uint8_t _loadFlags;
+	UnalignedInt<uint16_t> _setupMoveSize;
+	UnalignedInt<uint32_t> _code32Start;
+	UnalignedInt<uint32_t> _ramdiskImage;
+	UnalignedInt<uint32_t> _ramdiskSize;
+	UnalignedInt<uint32_t> _bootSectKludge;
+	UnalignedInt<uint16_t> _heapEndPtr;
+	uint8_t _extLoaderVer;
+	uint8_t _extLoaderType;
+	UnalignedInt<uint32_t> _cmdLinePtr;
+	UnalignedInt<uint32_t> _initrdAddrMax;
+	UnalignedInt<uint32_t> _kernelAlignment;
+	uint8_t _relocatableKernel;
+	uint8_t _minAlignment;
+	UnalignedInt<uint16_t> _xloadFlags;
+	UnalignedInt<uint32_t> _cmdLineSize;
+	UnalignedInt<uint32_t> _hardwareSubarch;
+	ByteBlob<8> _hardwareSubarchData;
+	UnalignedInt<uint32_t> _payloadOffset;
+	UnalignedInt<uint32_t> _payloadLength;
+	ByteBlob<8> _setupData;
+	ByteBlob<8> _prefAddress;
+	UnalignedInt<uint32_t> _initSize;
+	UnalignedInt<uint32_t> _handoverOffset;
+};
+
+static_assert(sizeof(LinuxSetupHeader) == 0x268 - LinuxSetupHeader::Offset);
+
+#endif /* LINUX_SETUP_HEADER_H */
@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * LocalApic.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef LOCAL_APIC_H
+#define LOCAL_APIC_H
+
+#include <cstdint>
+
+/*
+  Memory mapped xAPIC of the current CPU. Every CPU sees its own APIC at
+  the same address, so one instance serves all of them. The page must be
+  mapped uncached.
+*/
+class LocalApic {
+public:
+	static constexpr uint32_t DefaultBase = 0xFEE00000;
+
+	void Init(uintptr_t base) {
+		_base = base;
+	}
+
+	uintptr_t Base() const {
+		return _base;
+	}
+
+	uint8_t Id() const {
+		return Read(Reg::Id) >> 24;
+	}
+
+	// Software enable, with spurious interrupts going to vector 0xFF
+	void Enable() {
+		Write(Reg::Spurious, Read(Reg::Spurious) | 0x1FF);
+	}
+
+	void EndOfInterrupt() {
+		Write(Reg::Eoi, 0);
+	}
+
+	// For interrupt handlers written in assembly
+	volatile uint32_t *EoiRegister() const {
+		return (volatile uint32_t *)(_base + (uint32_t)Reg::Eoi);
+	}
+
+	// Fixed delivery, edge triggered
+	bool SendInterrupt(uint8_t apicId, uint8_t vector) {
+		return SendIpi(apicId, 0x00004000 | vector);
+	}
+
+	// Sends an INIT IPI, followed by a de-assert for ancient APICs
+	bool SendInit(uint8_t apicId) {
+		return SendIpi(apicId, 0x0000C500) &&
+			SendIpi(apicId, 0x00008500);
+	}
+
+	// Sends a startup IPI, the AP starts in real mode at vector:0000
+	bool SendStartup(uint8_t apicId, uint8_t vector) {
+		return SendIpi(apicId, 0x00004600 | vector);
+	}
+
+	// Timer ticks (bus clock divided by 16) that pass while delay() runs
+	template<typename F>
+	uint32_t MeasureTimer(F delay) {
+		Write(Reg::TimerDivide, 0x03);
+		Write(Reg::LvtTimer, 0x00010000);
+		Write(Reg::TimerInitial, 0xFFFFFFFF);
+
+		delay();
+
+		auto ticks = 0xFFFFFFFF - Read(Reg::TimerCurrent);
+
+		Write(Reg::TimerInitial, 0);
+		return ticks;
+	}
+
+	// Periodic interrupt, every count ticks of the bus clock divided by 16
+	void StartTimer(uint8_t vector, uint32_t count) {
+		Write(Reg::TimerDivide, 0x03);
+		Write(Reg::LvtTimer, 0x00020000 | vector);
+		Write(Reg::TimerInitial, count);
+	}
+
+	void StopTimer() {
+		Write(Reg::LvtTimer, 0x00010000);
+		Write(Reg::TimerInitial, 0);
+	}
+private:
+	enum class Reg : uint32_t {
+		Id = 0x020,
+		Eoi = 0x0B0,
+		Spurious = 0x0F0,
+		Error = 0x280,
+		IcrLow = 0x300,
+		IcrHigh = 0x310,
+		LvtTimer = 0x320,
+		TimerInitial = 0x380,
+		TimerCurrent = 0x390,
+		TimerDivide = 0x3E0,
+	};
+
+	uint32_t Read(Reg reg) const {
+		return *((volatile uint32_t *)(_base + (uint32_t)reg));
+	}
+
+	void Write(Reg reg, uint32_t value) {
+		*((volatile uint32_t *)(_base + (uint32_t)reg)) = value;
+	}
+
+	bool SendIpi(uint8_t apicId, uint32_t command) {
+		// writing the error register latches it, clear it first
+		Write(Reg::Error, 0);
+		Write(Reg::IcrHigh, (uint32_t)apicId << 24);
+		Write(Reg::IcrLow, command);
+
+		// wait for the delivery status to go idle
+		for (uint32_t i = 0; i < 1000000; ++i) {
+			if (!(Read(Reg::IcrLow) & 0x1000))
+				return true;
+		}
+
+		return false;
+	}
+
+	uintptr_t _base = 0;
+};
+
+#endif /* LOCAL_APIC_H */
@@ -0,0 +1,131 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * LogConsole.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef LOG_CONSOLE_H
+#define LOG_CONSOLE_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "device/VgaConsole.h"
+#include "device/SerialPort.h"
+#include "kernel/LogRing.h"
+#include "kernel/PerCpu.h"
+#include "kernel/Atomic.h"
+
+/*
+  TextScreen driver for the kernel, that any CPU can write to at any time.
+
+  Characters are collected in a line buffer of the calling CPU, which is
+  committed to a shared LogRing once a line is complete or the buffer is
+  full. Nothing in there takes a lock or touches the hardware.
+
+  Flush commits the caller's partial line and then drains the ring into
+  the VGA console and the serial port, in one batch. Only one CPU drains
+  at a time; if another one already does, Flush returns right away.
+
+  While only the boot CPU runs, a commit that fills the ring past
+  DrainThreshold drains it the same way, so a long stretch without a Flush
+  does not lose any lines. Once other CPUs run, writing to the polled UART
+  could stall whatever code happens to log, so only Flush drains.
+
+  Until SetMultiCpu is called, right before other CPUs are started,
+  everything is assumed to run on the boot CPU, possibly before it has a
+  PerCpu.
+
+  The backends are kept outside, so the console itself is all zero and
+  lands in the BSS instead of the kernel image.
+*/
+class LogConsole {
+public:
+	static constexpr size_t MaxCpus = 32;
+	static constexpr size_t LineSize = 124;
+	static constexpr size_t RingSize = 0x4000;
+	static constexpr size_t DrainThreshold = RingSize / 2;
+
+	void Init(VgaConsole *vga, SerialPort *serial) {
+		_vga = vga;
+		_serial = serial;
+	}
+
+	void Reset() {
+		_serial->Init();
+		_vga->Reset();
+	}
+
+	// Once every CPU that can log has a PerCpu with an index < MaxCpus
+	void SetMultiCpu() {
+		_multiCpu = true;
+		_ring.SetShared(true);
+	}
+
+	void PutChar(uint8_t c) {
+		auto &line = CurrentLine();
+
+		line.data[line.count++] = c;
+
+		if (c == '\n' || line.count == LineSize)
+			Commit(line);
+	}
+
+	void Flush() {
+		Commit(CurrentLine());
+		Drain();
+	}
+
+	// Number of lines lost, because the ring was full
+	uint32_t Dropped() const {
+		return _ring.Dropped();
+	}
+private:
+	// one cache line per CPU
+	struct alignas(64) Line {
+		char data[LineSize];
+		uint32_t count;
+	};
+
+	Line &CurrentLine() {
+		return _lines[_multiCpu ? PerCpu::Current()->Index() : 0];
+	}
+
+	void Commit(Line &line) {
+		if (line.count == 0)
+			return;
+
+		_ring.Write(line.data, line.count);
+		line.count = 0;
+
+		if (!_multiCpu && _ring.Used() >= DrainThreshold)
+			Drain();
+	}
+
+	void Drain() {
+		if (_multiCpu) {
+			if (!AtomicCompareExchange(&_draining, 0, 1))
+				return;
+		}
+
+		_ring.Drain([this](const char *data, size_t count) {
+			for (size_t i = 0; i < count; ++i)
+				_vga->PutChar(data[i]);
+
+			_serial->Write(data, count);
+		});
+
+		_vga->Flush();
+
+		__atomic_store_n(&_draining, 0, __ATOMIC_RELEASE);
+	}
+
+	Line _lines[MaxCpus]{};
+	LogRing<RingSize> _ring;
+	VgaConsole *_vga = nullptr;
+	SerialPort *_serial = nullptr;
+	volatile uint32_t _draining = 0;
+	bool _multiCpu = false;
+};
+
+#endif /* LOG_CONSOLE_H */
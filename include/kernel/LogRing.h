@@ -0,0 +1,168 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * LogRing.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "kernel/Atomic.h"
+
+/*
+  Lock free byte ring with many writers and a single reader.
+
+  Writers reserve space for a record by moving the head with a CAS, copy
+  their bytes in and then publish the record by setting the ready bit in
+  its 32 bit header. A record never wraps around the end of the buffer,
+  the space left over at the end is filled with a padding record instead.
+  If there is not enough space, the record is dropped and counted; writers
+  never wait for the reader.
+
+  The reader consumes ready records in order and stops at the first one
+  that is reserved but not published yet. It zeroes everything it
+  consumed before moving the tail, so a header slot always reads as not
+  ready until its writer publishes it.
+
+  As long as only one CPU is running, SetShared(false) makes the writers
+  use plain stores instead of locked instructions.
+*/
+template<size_t SIZE>
+class LogRing {
+public:
+	static_assert((SIZE & (SIZE - 1)) == 0);
+	static_assert(SIZE >= 64 && SIZE <= 0x10000);
+
+	static constexpr size_t MaxRecord = SIZE / 4 - sizeof(uint32_t);
+
+	void SetShared(bool shared) {
+		_shared = shared;
+	}
+
+	bool Write(const char *data, size_t count) {
+		if (count == 0 || count > MaxRecord)
+			return false;
+
+		uint32_t need = sizeof(uint32_t) + AlignUp(count);
+		uint32_t head, pad;
+
+		do {
+			head = Load(_head);
+
+			auto tail = Load(_tail);
+			auto room = SIZE - (head % SIZE);
+
+			pad = room < need ? room : 0;
+
+			if ((head + pad + need - tail) > SIZE) {
+				if (_shared) {
+					AtomicFetchAdd(&_dropped, 1);
+				} else {
+					_dropped += 1;
+				}
+				return false;
+			}
+		} while (!Reserve(head, head + pad + need));
+
+		if (pad > 0) {
+			Publish(head, Padding | (pad - sizeof(uint32_t)));
+			head += pad;
+		}
+
+		auto *dst = (volatile char *)_data +
+			(head % SIZE) + sizeof(uint32_t);
+
+		for (size_t i = 0; i < count; ++i)
+			dst[i] = data[i];
+
+		Publish(head, count);
+		return true;
+	}
+
+	// Reader only, calls sink(data, count) for every record
+	template<typename F>
+	size_t Drain(F sink) {
+		size_t total = 0;
+
+		for (;;) {
+			auto tail = _tail;
+
+			if (tail == Load(_head))
+				break;
+
+			auto pos = tail % SIZE;
+			auto hdr = __atomic_load_n(Header(pos), __ATOMIC_ACQUIRE);
+
+			if (!(hdr & Ready))
+				break;
+
+			uint32_t count = hdr & LengthMask;
+			uint32_t size = sizeof(uint32_t) + AlignUp(count);
+
+			if (!(hdr & Padding)) {
+				sink((const char *)_data + pos + sizeof(uint32_t),
+				     (size_t)count);
+				total += count;
+			}
+
+			auto *words = (volatile uint32_t *)Header(pos);
+
+			for (uint32_t i = 0; i < size / sizeof(uint32_t); ++i)
+				words[i] = 0;
+
+			__atomic_store_n(&_tail, tail + size, __ATOMIC_RELEASE);
+		}
+
+		return total;
+	}
+
+	uint32_t Dropped() const {
+		return Load(_dropped);
+	}
+
+	// Bytes in use, including the record headers and padding
+	uint32_t Used() const {
+		return Load(_head) - Load(_tail);
+	}
+private:
+	static constexpr uint32_t Ready = 0x80000000;
+	static constexpr uint32_t Padding = 0x40000000;
+	static constexpr uint32_t LengthMask = 0x0000FFFF;
+
+	static uint32_t AlignUp(uint32_t x) {
+		return (x + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1);
+	}
+
+	static uint32_t Load(const volatile uint32_t &x) {
+		return __atomic_load_n(&x, __ATOMIC_ACQUIRE);
+	}
+
+	volatile uint32_t *Header(uint32_t pos) {
+		return (volatile uint32_t *)(_data + pos);
+	}
+
+	bool Reserve(uint32_t head, uint32_t newHead) {
+		if (_shared)
+			return AtomicCompareExchange(&_head, head, newHead);
+
+		_head = newHead;
+		return true;
+	}
+
+	void Publish(uint32_t pos, uint32_t hdr) {
+		__atomic_store_n(Header(pos % SIZE), hdr | Ready,
+				 __ATOMIC_RELEASE);
+	}
+
+	// writers hammer on the head, the reader owns the tail
+	alignas(64) volatile uint32_t _head = 0;
+	volatile uint32_t _dropped = 0;
+	bool _shared = false;
+	alignas(64) volatile uint32_t _tail = 0;
+	alignas(64) char _data[SIZE]{};
+};
+
+#endif /* LOG_RING_H */
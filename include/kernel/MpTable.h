@@ -0,0 +1,152 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * MpTable.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef MP_TABLE_H
+#define MP_TABLE_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "types/UnalignedInt.h"
+#include "kernel/BiosDataArea.h"
+
+/*
+  Intel MultiProcessor Specification 1.4 tables, that pre-ACPI systems
+  (and most emulators) use to describe the processors. Only used if there
+  is no ACPI MADT.
+*/
+class MpConfigTable {
+public:
+	bool IsValid() const {
+		static const char sig[] = "PCMP";
+
+		for (size_t i = 0; i < sizeof(_signature); ++i) {
+			if (_signature[i] != sig[i])
+				return false;
+		}
+
+		auto *ptr = (const uint8_t *)this;
+		uint8_t sum = 0;
+
+		for (size_t i = 0; i < _baseLength.Read(); ++i)
+			sum += ptr[i];
+
+		return _baseLength.Read() >= sizeof(*this) && sum == 0;
+	}
+
+	uint32_t LocalApicAddress() const {
+		return _localApic.Read();
+	}
+
+	// Calls fn(apicId) for each enabled processor
+	template<typename F>
+	void ForEachCpu(F fn) const {
+		auto *ent = (const uint8_t *)(this + 1);
+		auto *end = (const uint8_t *)this + _baseLength.Read();
+
+		for (uint16_t i = 0; i < _entryCount.Read() && ent < end; ++i) {
+			// processor entries are 20 bytes, all others 8
+			if (ent[0] != EntryProcessor) {
+				ent += 8;
+				continue;
+			}
+
+			if (ent[3] & FlagEnabled)
+				fn(ent[1]);
+
+			ent += 20;
+		}
+	}
+private:
+	static constexpr uint8_t EntryProcessor = 0;
+	static constexpr uint8_t FlagEnabled = 0x01;
+
+	char _signature[4];
+	UnalignedInt<uint16_t> _baseLength;
+	uint8_t _revision;
+	uint8_t _checksum;
+	char _oemId[8];
+	char _productId[12];
+	UnalignedInt<uint32_t> _oemTable;
+	UnalignedInt<uint16_t> _oemTableSize;
+	UnalignedInt<uint16_t> _entryCount;
+	UnalignedInt<uint32_t> _localApic;
+	UnalignedInt<uint16_t> _extLength;
+	uint8_t _extChecksum;
+	uint8_t _reserved;
+};
+
+static_assert(sizeof(MpConfigTable) == 44);
+
+class MpFloatingPointer {
+public:
+	// Searches the EBDA, the last KiB of base memory and the BIOS ROM
+	static const MpFloatingPointer *Find() {
+		uintptr_t ebda = BiosDataWord(BdaEbdaSegment) << 4;
+		uintptr_t baseEnd = BiosDataWord(BdaBaseMemoryKiB) * 1024;
+		const MpFloatingPointer *ret = nullptr;
+
+		if (ebda != 0 && ebda < 0xA0000)
+			ret = Scan(ebda, ebda + 1024);
+
+		if (ret == nullptr && baseEnd >= 1024 && baseEnd <= 0xA0000)
+			ret = Scan(baseEnd - 1024, baseEnd);
+
+		if (ret == nullptr)
+			ret = Scan(0xF0000, 0x100000);
+
+		return ret;
+	}
+
+	// nullptr if the system uses one of the default configurations
+	const MpConfigTable *ConfigTable() const {
+		auto *table = (const MpConfigTable *)_configTable.Read();
+
+		if (_features[0] != 0 || table == nullptr || !table->IsValid())
+			return nullptr;
+
+		return table;
+	}
+private:
+	static const MpFloatingPointer *Scan(uintptr_t start, uintptr_t end) {
+		for (; start < end; start += 16) {
+			auto *mp = (const MpFloatingPointer *)start;
+
+			if (mp->IsValid())
+				return mp;
+		}
+
+		return nullptr;
+	}
+
+	bool IsValid() const {
+		static const char sig[] = "_MP_";
+
+		for (size_t i = 0; i < sizeof(_signature); ++i) {
+			if (_signature[i] != sig[i])
+				return false;
+		}
+
+		auto *ptr = (const uint8_t *)this;
+		uint8_t sum = 0;
+
+		for (size_t i = 0; i < sizeof(*this); ++i)
+			sum += ptr[i];
+
+		return _length == 1 && sum == 0;
+	}
+
+	char _signature[4];
+	UnalignedInt<uint32_t> _configTable;
+	uint8_t _length;
+	uint8_t _revision;
+	uint8_t _checksum;
+	uint8_t _features[5];
+};
+
+static_assert(sizeof(MpFloatingPointer) == 16);
+
+#endif /* MP_TABLE_H */
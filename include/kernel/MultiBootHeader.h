@@ -69,7 +69,7 @@ public:
 	}
 
 	void *EntryPoint() const {
-		return (void *)_entryAddr;
+		return (void *)(uintptr_t)_entryAddr;
 	}
 
 	size_t BSSSize() const {
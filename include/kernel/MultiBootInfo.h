@@ -9,6 +9,7 @@
 
 #include <cstdint>
 
+#include "kernel/MultiBootModule.h"
 #include "kernel/MultiBootMmap.h"
 #include "types/FlagField.h"
 
@@ -49,6 +50,26 @@ public:
 		return _cmdline;
 	}
 
+	void SetModules(const MultiBootModule *array, size_t count) {
+		_modsCount = count;
+		_modsAddr = (uint32_t)array;
+		_flags.Set(InfoFlag::Mods);
+	}
+
+	const MultiBootModule *ModulesBegin() const {
+		if (!_flags.IsSet(InfoFlag::Mods))
+			return nullptr;
+
+		return (const MultiBootModule *)_modsAddr;
+	}
+
+	const MultiBootModule *ModulesEnd() const {
+		if (!_flags.IsSet(InfoFlag::Mods))
+			return nullptr;
+
+		return ModulesBegin() + _modsCount;
+	}
+
 	const MultiBootMmap *MemoryMapBegin() const {
 		if (!_flags.IsSet(InfoFlag::MemMap))
 			return nullptr;
@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * MultiBootModule.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef MULTIBOOT_MODULE_H
+#define MULTIBOOT_MODULE_H
+
+#include <cstdint>
+
+class MultiBootModule {
+public:
+	void Set(uint32_t start, uint32_t end, const char *string) {
+		_modStart = start;
+		_modEnd = end;
+		_string = string;
+		_reserved = 0;
+	}
+
+	auto Start() const {
+		return _modStart;
+	}
+
+	auto End() const {
+		return _modEnd;
+	}
+
+	const char *String() const {
+		return _string;
+	}
+private:
+	uint32_t _modStart;
+	uint32_t _modEnd;
+	const char *_string;
+	uint32_t _reserved;
+};
+
+static_assert(sizeof(MultiBootModule) == 16);
+
+#endif /* MULTIBOOT_MODULE_H */
@@ -0,0 +1,230 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * PageAllocator.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef PAGE_ALLOCATOR_H
+#define PAGE_ALLOCATOR_H
+
+#include <cstdint>
+#include <cstddef>
+
+/*
+  Binary buddy allocator for physical page frames.
+
+  Memory is handed out in blocks of 2^order pages, naturally aligned to
+  their size. Free blocks of each order are kept on a doubly linked list
+  that lives in the free pages themselves, so allocating and freeing never
+  scan anything and take at most MaxOrder steps.
+
+  The only other bookkeeping is a bitmap per order, where a set bit marks a
+  block that is on a free list. It is used to find out if the buddy of a
+  block that is being freed can be merged with it. All bitmaps together
+  need 2 bits per page frame, i.e. about 256k for 4G of memory.
+
+  The allocator assumes that physical memory is identity mapped and only
+  manages frames below 4G.
+*/
+class PageAllocator {
+public:
+	static constexpr size_t PageSize = 4096;
+	static constexpr unsigned MaxOrder = 10;
+	static constexpr uint64_t Limit = 0x1'0000'0000;
+
+	// Bytes of bookkeeping data needed to manage frames below `limit`
+	static size_t MetadataSize(uint64_t limit) {
+		auto frames = FrameCount(limit);
+		size_t size = 0;
+
+		for (unsigned k = 0; k <= MaxOrder; ++k)
+			size += MapWords(frames, k) * sizeof(uint32_t);
+
+		return size;
+	}
+
+	// Sets up an empty allocator, `meta` is MetadataSize(limit) bytes
+	void Init(void *meta, uint64_t limit) {
+		auto *words = (uint32_t *)meta;
+
+		_frameCount = FrameCount(limit);
+		_freePages = 0;
+
+		for (unsigned k = 0; k <= MaxOrder; ++k) {
+			auto count = MapWords(_frameCount, k);
+
+			_map[k] = words;
+			_free[k] = nullptr;
+
+			for (size_t i = 0; i < count; ++i)
+				words[i] = 0;
+
+			words += count;
+		}
+	}
+
+	// Hands the page aligned range [start, end) to the allocator
+	void AddRange(uint64_t start, uint64_t end) {
+		if (end > ((uint64_t)_frameCount * PageSize))
+			end = (uint64_t)_frameCount * PageSize;
+
+		uint32_t pfn = (start + PageSize - 1) / PageSize;
+		uint32_t last = end / PageSize;
+
+		while (pfn < last) {
+			unsigned order = 0;
+
+			while (order < MaxOrder) {
+				uint32_t next = 1U << (order + 1);
+
+				if ((pfn & (next - 1)) || next > (last - pfn))
+					break;
+
+				++order;
+			}
+
+			Release(pfn, order);
+			pfn += 1U << order;
+		}
+	}
+
+	// Returns a block of 2^order pages, or nullptr if there is none
+	void *Alloc(unsigned order = 0) {
+		unsigned k = order;
+
+		while (k <= MaxOrder && _free[k] == nullptr)
+			++k;
+
+		if (k > MaxOrder)
+			return nullptr;
+
+		auto *block = _free[k];
+		uint32_t pfn = ToFrame(block);
+
+		Unlink(block, k);
+
+		// put the unused upper halves back
+		while (k > order) {
+			--k;
+			Link(pfn + (1U << k), k);
+		}
+
+		_freePages -= 1U << order;
+		return block;
+	}
+
+	void Free(void *ptr, unsigned order = 0) {
+		if (ptr == nullptr || order > MaxOrder)
+			return;
+
+		uint32_t pfn = ToFrame(ptr);
+
+		if (pfn >= _frameCount || (pfn & ((1U << order) - 1)))
+			return;
+
+		// catch the obvious case of a double free
+		if (TestBit(order, pfn >> order))
+			return;
+
+		Release(pfn, order);
+	}
+
+	size_t FreePages() const {
+		return _freePages;
+	}
+
+	// Number of free blocks of the given order, walks the free list
+	size_t FreeBlocks(unsigned order) const {
+		size_t count = 0;
+
+		for (auto *it = _free[order]; it != nullptr; it = it->next)
+			++count;
+
+		return count;
+	}
+private:
+	struct FreeBlock {
+		FreeBlock *next;
+		FreeBlock *prev;
+	};
+
+	static uint32_t FrameCount(uint64_t limit) {
+		if (limit > Limit)
+			limit = Limit;
+
+		return limit / PageSize;
+	}
+
+	static size_t MapWords(uint32_t frames, unsigned order) {
+		size_t blocks = (frames >> order) + 1;
+
+		return (blocks + 31) / 32;
+	}
+
+	static FreeBlock *ToBlock(uint32_t pfn) {
+		return (FreeBlock *)((uintptr_t)pfn * PageSize);
+	}
+
+	static uint32_t ToFrame(const void *ptr) {
+		return (uintptr_t)ptr / PageSize;
+	}
+
+	bool TestBit(unsigned order, uint32_t index) const {
+		return (_map[order][index / 32] >> (index % 32)) & 1;
+	}
+
+	void FlipBit(unsigned order, uint32_t index) {
+		_map[order][index / 32] ^= 1U << (index % 32);
+	}
+
+	void Link(uint32_t pfn, unsigned order) {
+		auto *block = ToBlock(pfn);
+
+		block->prev = nullptr;
+		block->next = _free[order];
+
+		if (block->next != nullptr)
+			block->next->prev = block;
+
+		_free[order] = block;
+		FlipBit(order, pfn >> order);
+	}
+
+	void Unlink(FreeBlock *block, unsigned order) {
+		if (block->prev != nullptr) {
+			block->prev->next = block->next;
+		} else {
+			_free[order] = block->next;
+		}
+
+		if (block->next != nullptr)
+			block->next->prev = block->prev;
+
+		FlipBit(order, ToFrame(block) >> order);
+	}
+
+	// Merges a block with its free buddies and puts it on a free list
+	void Release(uint32_t pfn, unsigned order) {
+		_freePages += 1U << order;
+
+		while (order < MaxOrder) {
+			uint32_t buddy = pfn ^ (1U << order);
+
+			if (buddy >= _frameCount || !TestBit(order, buddy >> order))
+				break;
+
+			Unlink(ToBlock(buddy), order);
+			pfn &= ~(1U << order);
+			++order;
+		}
+
+		Link(pfn, order);
+	}
+
+	FreeBlock *_free[MaxOrder + 1]{};
+	uint32_t *_map[MaxOrder + 1]{};
+	uint32_t _frameCount = 0;
+	size_t _freePages = 0;
+};
+
+#endif /* PAGE_ALLOCATOR_H */
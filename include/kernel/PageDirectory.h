@@ -0,0 +1,161 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * PageDirectory.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef PAGE_DIRECTORY_H
+#define PAGE_DIRECTORY_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "types/FlagField.h"
+#include "kernel/Cpu.h"
+
+/*
+  Two level, 32 bit x86 page tables (i.e. without PAE), for identity
+  mapping physical memory.
+
+  If large pages are enabled, every 4M region that is mapped completely
+  uses a single PSE directory entry instead of a page table. Only regions
+  with holes in them, or with differing attributes, get a page table.
+
+  The page directory and tables are allocated through a callback, that
+  must return zero filled, page aligned memory or nullptr.
+*/
+class PageDirectory {
+public:
+	enum class Flag : uint32_t {
+		Present = 0x001,
+		Writable = 0x002,
+		User = 0x004,
+		WriteThrough = 0x008,
+		CacheDisable = 0x010,
+		Accessed = 0x020,
+		Dirty = 0x040,
+		Large = 0x080,
+		Global = 0x100,
+	};
+
+	using Flags = FlagField<Flag, uint32_t>;
+	using TableAllocator = void *(*)();
+
+	static constexpr uint64_t PageSize = 0x1000;
+	static constexpr uint64_t LargePageSize = 0x400000;
+	static constexpr uint64_t Limit = 0x1'0000'0000;
+
+	bool Init(TableAllocator alloc, bool largePages) {
+		_alloc = alloc;
+		_largePages = largePages;
+		_dir = (uint32_t *)_alloc();
+
+		return _dir != nullptr;
+	}
+
+	// Identity maps the pages touched by [start, end)
+	bool Map(uint64_t start, uint64_t end, Flags flags) {
+		uint32_t bits = flags.RawValue() | (uint32_t)Flag::Present;
+
+		start &= ~(PageSize - 1);
+		end = (end + PageSize - 1) & ~(PageSize - 1);
+
+		if (end > Limit)
+			end = Limit;
+
+		while (start < end) {
+			auto &pde = _dir[start / LargePageSize];
+			uint64_t next = (start / LargePageSize + 1) * LargePageSize;
+
+			if (_largePages && !(pde & (uint32_t)Flag::Present) &&
+			    (start % LargePageSize) == 0 && next <= end) {
+				pde = start | bits | (uint32_t)Flag::Large;
+				_largeCount += 1;
+				start = next;
+				continue;
+			}
+
+			if ((pde & (uint32_t)Flag::Large) &&
+			    (pde & AttribMask) == (bits | (uint32_t)Flag::Large)) {
+				start = next;
+				continue;
+			}
+
+			auto *table = Table(pde, bits);
+			if (table == nullptr)
+				return false;
+
+			for (; start < end && start < next; start += PageSize) {
+				auto idx = (start / PageSize) % 1024;
+
+				table[idx] = start | bits;
+			}
+		}
+
+		// changing the tables of the active address space
+		if (_active)
+			WriteCr3((uintptr_t)_dir);
+
+		return true;
+	}
+
+	void Activate() {
+		if (_largePages)
+			WriteCr4(ReadCr4() | Cr4PageSizeExt);
+
+		WriteCr3((uintptr_t)_dir);
+		WriteCr0(ReadCr0() | Cr0PagingEnable);
+		_active = true;
+	}
+
+	size_t LargePageCount() const {
+		return _largeCount;
+	}
+
+	size_t TableCount() const {
+		return _tableCount;
+	}
+private:
+	// ignores the bits that the CPU sets on access
+	static constexpr uint32_t AttribMask = 0xFFF &
+		~((uint32_t)Flag::Accessed | (uint32_t)Flag::Dirty);
+
+	// Returns the page table for a directory entry, creates it if needed
+	uint32_t *Table(uint32_t &pde, uint32_t bits) {
+		if ((pde & (uint32_t)Flag::Present) &&
+		    !(pde & (uint32_t)Flag::Large)) {
+			return (uint32_t *)(uintptr_t)(pde & ~0xFFFU);
+		}
+
+		auto *table = (uint32_t *)_alloc();
+		if (table == nullptr)
+			return nullptr;
+
+		// split up a large page, keeping its attributes
+		if (pde & (uint32_t)Flag::Large) {
+			uint32_t base = pde & ~(uint32_t)(LargePageSize - 1);
+			uint32_t attr = pde & 0xFFF & ~(uint32_t)Flag::Large;
+
+			for (uint32_t i = 0; i < 1024; ++i)
+				table[i] = (base + i * PageSize) | attr;
+
+			_largeCount -= 1;
+		}
+
+		uint32_t dirBits = (uint32_t)Flag::Present |
+			(uint32_t)Flag::Writable | (bits & (uint32_t)Flag::User);
+
+		pde = (uintptr_t)table | dirBits;
+		_tableCount += 1;
+		return table;
+	}
+
+	uint32_t *_dir = nullptr;
+	TableAllocator _alloc = nullptr;
+	size_t _largeCount = 0;
+	size_t _tableCount = 0;
+	bool _largePages = false;
+	bool _active = false;
+};
+
+#endif /* PAGE_DIRECTORY_H */
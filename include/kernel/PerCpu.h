@@ -0,0 +1,149 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * PerCpu.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef PER_CPU_H
+#define PER_CPU_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "kernel/Atomic.h"
+
+/*
+  Data that belongs to a single CPU. Each CPU has its own GDT in here, with
+  the same flat code and data segments as the boot GDT, plus a data segment
+  that covers only this structure. It is loaded into FS, so a CPU can find
+  its own data without knowing its index.
+
+  Application processors get theirs from the kernel heap, which puts it on
+  its own cache line. An AP that comes up after the boot CPU gave up on it
+  must not touch anything shared, so it only goes on to run once the boot
+  CPU has seen it online and released it.
+*/
+class PerCpu {
+public:
+	static constexpr uint16_t CodeSelector = 0x08;
+	static constexpr uint16_t DataSelector = 0x10;
+	static constexpr uint16_t SelfSelector = 0x18;
+
+	void Init(uint32_t index, uint8_t apicId) {
+		_self = this;
+		_index = index;
+		_apicId = apicId;
+		_state = StateStarting;
+
+		_gdt[0] = 0;
+		_gdt[1] = Segment(0, 0xFFFFF, 0x9A, 0x0C);
+		_gdt[2] = Segment(0, 0xFFFFF, 0x92, 0x0C);
+		_gdt[3] = Segment((uintptr_t)this, sizeof(*this) - 1, 0x92, 0x04);
+	}
+
+	// Switches the calling CPU over to this GDT
+	void LoadGdt() {
+		struct __attribute__((packed)) {
+			uint16_t limit;
+			uint32_t base;
+		} desc = { sizeof(_gdt) - 1, (uint32_t)_gdt };
+
+		__asm__ __volatile__("lgdt %0\n\t"
+				     "ljmp %1, $1f\n"
+				     "1:\n\t"
+				     "movw %2, %%ax\n\t"
+				     "movw %%ax, %%ds\n\t"
+				     "movw %%ax, %%es\n\t"
+				     "movw %%ax, %%gs\n\t"
+				     "movw %%ax, %%ss\n\t"
+				     "movw %3, %%ax\n\t"
+				     "movw %%ax, %%fs"
+				     : : "m"(desc), "i"(CodeSelector),
+				       "i"(DataSelector), "i"(SelfSelector)
+				     : "eax", "memory");
+	}
+
+	// The PerCpu of the calling CPU, once LoadGdt was called on it
+	static PerCpu *Current() {
+		PerCpu *ret;
+
+		__asm__ __volatile__("movl %%fs:0, %0" : "=r"(ret));
+		return ret;
+	}
+
+	uint32_t Index() const {
+		return _index;
+	}
+
+	uint8_t ApicId() const {
+		return _apicId;
+	}
+
+	bool IsOnline() const {
+		auto state = __atomic_load_n(&_state, __ATOMIC_ACQUIRE);
+
+		return state == StateOnline || state == StateRunning;
+	}
+
+	// From the AP itself, fails if the boot CPU has already given up on it
+	bool SetOnline() {
+		return AtomicCompareExchange(&_state, StateStarting,
+					     StateOnline);
+	}
+
+	// From the boot CPU on a timeout, fails if the AP just came online
+	bool Abandon() {
+		return AtomicCompareExchange(&_state, StateStarting,
+					     StateAbandoned);
+	}
+
+	// Lets the CPU run, once the boot CPU has registered it everywhere
+	void Release() {
+		__atomic_store_n(&_state, StateRunning, __ATOMIC_RELEASE);
+	}
+
+	void WaitReleased() const {
+		while (__atomic_load_n(&_state, __ATOMIC_ACQUIRE) !=
+		       StateRunning) {
+			CpuRelax();
+		}
+	}
+private:
+	static constexpr uint32_t StateStarting = 0;
+	static constexpr uint32_t StateOnline = 1;
+	static constexpr uint32_t StateAbandoned = 2;
+	static constexpr uint32_t StateRunning = 3;
+
+	static constexpr uint64_t Segment(uint32_t base, uint32_t limit,
+					  uint8_t access, uint8_t flags) {
+		return (limit & 0xFFFFULL) |
+			((uint64_t)(base & 0xFFFFFF) << 16) |
+			((uint64_t)access << 40) |
+			((uint64_t)((limit >> 16) & 0x0F) << 48) |
+			((uint64_t)(flags & 0x0F) << 52) |
+			((uint64_t)(base >> 24) << 56);
+	}
+
+	// must stay first, read through FS by Current()
+	PerCpu *_self;
+	uint32_t _index;
+	uint8_t _apicId;
+	volatile uint32_t _state;
+	uint64_t _gdt[4];
+};
+
+/*
+  Handed to an application processor by the real mode trampoline in
+  kernel/abi.S, which loads the boot CPU's paging setup and stack from it
+  before calling ap_main.
+*/
+struct ApBootParams {
+	uint32_t cr3;
+	uint32_t cr4;
+	uint32_t stack;
+	PerCpu *cpu;
+};
+
+static_assert(sizeof(ApBootParams) == 16);
+
+#endif /* PER_CPU_H */
@@ -0,0 +1,202 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * PhysRangeList.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef PHYS_RANGE_LIST_H
+#define PHYS_RANGE_LIST_H
+
+#include <cstdint>
+#include <cstddef>
+
+/*
+  A sorted list of non-overlapping physical address ranges.
+
+  Ranges are half open, i.e. `end` is the first byte after the range.
+  Adding a range merges it with any overlapping or adjacent ranges,
+  removing a range cuts it out, splitting entries if necessary.
+
+  The list has a fixed capacity and no constructor, so it can be used
+  before there is any memory management at all. If it runs out of space,
+  the operations fail and leave the list in a state where it describes
+  less memory than requested, never more.
+*/
+struct PhysRange {
+	uint64_t start;
+	uint64_t end;
+
+	uint64_t Size() const {
+		return end - start;
+	}
+};
+
+template<size_t MAX_COUNT>
+class PhysRangeList {
+public:
+	bool Add(uint64_t start, uint64_t end) {
+		if (start >= end)
+			return true;
+
+		size_t i = 0;
+
+		while (i < _count && _ranges[i].end < start)
+			++i;
+
+		// no overlap with anything, insert a new entry
+		if (i == _count || _ranges[i].start > end)
+			return Insert(i, start, end);
+
+		// grow entry i and swallow everything it now touches
+		if (start < _ranges[i].start)
+			_ranges[i].start = start;
+		if (end > _ranges[i].end)
+			_ranges[i].end = end;
+
+		size_t j = i + 1;
+
+		while (j < _count && _ranges[j].start <= _ranges[i].end) {
+			if (_ranges[j].end > _ranges[i].end)
+				_ranges[i].end = _ranges[j].end;
+			++j;
+		}
+
+		Erase(i + 1, j - (i + 1));
+		return true;
+	}
+
+	bool Remove(uint64_t start, uint64_t end) {
+		if (start >= end)
+			return true;
+
+		for (size_t i = 0; i < _count; ) {
+			auto &r = _ranges[i];
+
+			if (r.end <= start) {
+				++i;
+				continue;
+			}
+
+			if (r.start >= end)
+				break;
+
+			if (r.start >= start && r.end <= end) {
+				Erase(i, 1);
+				continue;
+			}
+
+			if (r.start < start && r.end > end) {
+				auto tail = r.end;
+
+				r.end = start;
+				return Insert(i + 1, end, tail);
+			}
+
+			if (r.start < start) {
+				r.end = start;
+			} else {
+				r.start = end;
+			}
+			++i;
+		}
+
+		return true;
+	}
+
+	// Cuts `size` bytes off the front of the first range at or above
+	// `minAddr` that is big enough, returns the start address or 0
+	uint64_t TakeFront(uint64_t size, uint64_t minAddr) {
+		for (size_t i = 0; i < _count; ++i) {
+			auto &r = _ranges[i];
+
+			if (r.start < minAddr || r.start == 0 || r.Size() < size)
+				continue;
+
+			auto start = r.start;
+
+			r.start += size;
+
+			if (r.start == r.end)
+				Erase(i, 1);
+
+			return start;
+		}
+
+		return 0;
+	}
+
+	// Shrinks all ranges inwards to multiples of `align`
+	void Align(uint64_t align) {
+		for (size_t i = 0; i < _count; ) {
+			auto start = AlignUp(_ranges[i].start, align);
+			auto end = AlignDown(_ranges[i].end, align);
+
+			if (start >= end) {
+				Erase(i, 1);
+				continue;
+			}
+
+			_ranges[i].start = start;
+			_ranges[i].end = end;
+			++i;
+		}
+	}
+
+	uint64_t TotalSize() const {
+		uint64_t total = 0;
+
+		for (size_t i = 0; i < _count; ++i)
+			total += _ranges[i].Size();
+
+		return total;
+	}
+
+	uint64_t HighestAddress() const {
+		return _count > 0 ? _ranges[_count - 1].end : 0;
+	}
+
+	size_t Count() const {
+		return _count;
+	}
+
+	const PhysRange *begin() const {
+		return _ranges;
+	}
+
+	const PhysRange *end() const {
+		return _ranges + _count;
+	}
+
+	static uint64_t AlignUp(uint64_t x, uint64_t align) {
+		return (x + align - 1) & ~(align - 1);
+	}
+
+	static uint64_t AlignDown(uint64_t x, uint64_t align) {
+		return x & ~(align - 1);
+	}
+private:
+	bool Insert(size_t index, uint64_t start, uint64_t end) {
+		if (_count >= MAX_COUNT)
+			return false;
+
+		for (size_t i = _count; i > index; --i)
+			_ranges[i] = _ranges[i - 1];
+
+		_ranges[index].start = start;
+		_ranges[index].end = end;
+		_count += 1;
+		return true;
+	}
+
+	void Erase(size_t index, size_t count) {
+		for (size_t i = index; (i + count) < _count; ++i)
+			_ranges[i] = _ranges[i + count];
+
+		_count -= count;
+	}
+
+	PhysRange _ranges[MAX_COUNT]{};
+	size_t _count = 0;
+};
+
+#endif /* PHYS_RANGE_LIST_H */
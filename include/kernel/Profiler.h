@@ -0,0 +1,118 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * Profiler.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "Memory.h"
+#include "pm86.h"
+
+/*
+  Sampling profiler. A periodic timer interrupt hands the interrupted EIP
+  to Sample, which counts it in a histogram of the kernel text belonging
+  to the current CPU. Every bucket covers a few bytes of code. Addresses
+  outside the kernel text are only counted.
+
+  Dump prints the non-empty buckets, to be resolved against the kernel's
+  link map on the host (see test/kernelprof.py):
+    @profile <bucket size> <cpus>
+    @cpu <index> <samples> <outside of the kernel text>
+    @pc <address> <samples>
+*/
+class Profiler {
+public:
+	static constexpr size_t MaxCpus = 32;
+	static constexpr unsigned BucketShift = 4;
+
+	void Init(uintptr_t textStart, uintptr_t textEnd) {
+		_start = textStart;
+		_count = ((textEnd - textStart) >> BucketShift) + 1;
+	}
+
+	// Called before the CPU gets its first timer interrupt
+	bool AddCpu(uint32_t index) {
+		if (index >= MaxCpus)
+			return false;
+
+		auto *buckets = new uint32_t[_count];
+
+		if (buckets == nullptr)
+			return false;
+
+		ClearMemory32(buckets, _count * sizeof(*buckets));
+		_cpus[index].buckets = buckets;
+
+		if (index >= _cpuCount)
+			_cpuCount = index + 1;
+		return true;
+	}
+
+	void SetEnabled(bool enabled) {
+		__atomic_store_n(&_enabled, enabled, __ATOMIC_RELEASE);
+	}
+
+	// From the timer interrupt of the CPU
+	void Sample(uint32_t index, uintptr_t eip) {
+		auto &h = _cpus[index];
+
+		if (!__atomic_load_n(&_enabled, __ATOMIC_ACQUIRE) ||
+		    h.buckets == nullptr) {
+			return;
+		}
+
+		auto bucket = (eip - _start) >> BucketShift;
+
+		if (eip < _start || bucket >= _count) {
+			h.other += 1;
+		} else {
+			h.buckets[bucket] += 1;
+		}
+
+		h.total += 1;
+	}
+
+	template<class OUT>
+	void Dump(OUT &out) const {
+		out << "@profile " << (uint32_t)(1 << BucketShift) << " "
+		    << _cpuCount << "\r\n";
+
+		for (uint32_t i = 0; i < _cpuCount; ++i) {
+			auto &h = _cpus[i];
+
+			if (h.buckets == nullptr)
+				continue;
+
+			out << "@cpu " << i << " " << h.total << " "
+			    << h.other << "\r\n";
+
+			for (size_t j = 0; j < _count; ++j) {
+				if (h.buckets[j] == 0)
+					continue;
+
+				out << "@pc ";
+				out.WriteHex(_start + (j << BucketShift));
+				out << " " << h.buckets[j] << "\r\n";
+			}
+		}
+	}
+private:
+	struct Histogram {
+		uint32_t *buckets;
+		uint32_t total;
+		uint32_t other;
+	};
+
+	Histogram _cpus[MaxCpus]{};
+	uintptr_t _start = 0;
+	size_t _count = 0;
+	uint32_t _cpuCount = 0;
+	bool _enabled = false;
+};
+
+#endif /* PROFILER_H */
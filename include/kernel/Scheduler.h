@@ -0,0 +1,263 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * Scheduler.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "kernel/WorkDeque.h"
+#include "kernel/LocalApic.h"
+#include "kernel/PerCpu.h"
+#include "kernel/Atomic.h"
+
+/*
+  Work stealing task runtime.
+
+  Every CPU has a deque of tasks. A CPU works on its own deque in LIFO
+  order and, once that runs dry, steals the oldest task of a randomly
+  chosen other CPU. CPUs that find nothing go to sleep, either with
+  MONITOR/MWAIT on their own sleep flag, or with HLT, in which case they
+  are woken up with an IPI. Whoever pushes a task wakes up one sleeper.
+
+  The only kind of task right now is a slice of a ParallelFor index range,
+  which is split in half until it reaches the grain size, pushing the upper
+  halves for others to steal. The calling CPU takes part in the work and
+  returns once all indices are done.
+
+  With a single CPU, ParallelFor simply runs the loop.
+*/
+class Scheduler {
+public:
+	static constexpr size_t MaxCpus = 32;
+	static constexpr uint8_t WakeupVector = 0xF0;
+
+	struct Stats {
+		uint32_t tasks;
+		uint32_t steals;
+		uint32_t sleeps;
+	};
+
+	void Init(LocalApic *apic, bool useMwait) {
+		_apic = apic;
+		_mwait = useMwait;
+	}
+
+	// Called on the boot CPU, before the CPU runs anything
+	void AddCpu(uint32_t index, uint8_t apicId) {
+		auto &w = _workers[index];
+
+		w.apicId = apicId;
+		w.seed = 0x9E3779B9 * (index + 1);
+
+		if (index >= Load(_count))
+			__atomic_store_n(&_count, index + 1, __ATOMIC_RELEASE);
+	}
+
+	// Main loop of the application processors
+	[[noreturn]] void WorkerLoop(uint32_t index) {
+		auto &w = _workers[index];
+		Task task;
+
+		for (;;) {
+			if (FindTask(w, task)) {
+				Run(w, task);
+			} else {
+				Idle(w);
+			}
+		}
+	}
+
+	// Calls fn(i) for every i in [begin, end), on all CPUs
+	template<typename F>
+	void ParallelFor(uint32_t begin, uint32_t end, uint32_t grain, F fn) {
+		if (begin >= end)
+			return;
+
+		if (Load(_count) < 2) {
+			for (uint32_t i = begin; i < end; ++i)
+				fn(i);
+			return;
+		}
+
+		Job job;
+		job.invoke = [](void *fn, uint32_t lo, uint32_t hi) {
+			for (uint32_t i = lo; i < hi; ++i)
+				(*(F *)fn)(i);
+		};
+		job.fn = &fn;
+		job.grain = grain > 0 ? grain : 1;
+		job.remaining = end - begin;
+
+		auto &w = _workers[PerCpu::Current()->Index()];
+		Task task{&job, begin, end};
+
+		Run(w, task);
+
+		// help out until everything is done, possibly with other jobs
+		while (Load(job.remaining) != 0) {
+			if (FindTask(w, task)) {
+				Run(w, task);
+			} else {
+				CpuRelax();
+			}
+		}
+	}
+
+	const Stats &CpuStats(uint32_t index) const {
+		return _workers[index].stats;
+	}
+private:
+	struct Job {
+		void (*invoke)(void *fn, uint32_t lo, uint32_t hi);
+		void *fn;
+		uint32_t grain;
+		volatile uint32_t remaining;
+	};
+
+	struct Task {
+		Job *job;
+		uint32_t begin;
+		uint32_t end;
+	};
+
+	struct Worker {
+		WorkDeque<Task, 128> deque;
+
+		// written by other CPUs, monitored by MWAIT
+		alignas(64) volatile uint32_t sleeping = 0;
+		alignas(64) uint32_t seed = 0;
+		uint8_t apicId = 0;
+		Stats stats{};
+	};
+
+	static uint32_t Load(const volatile uint32_t &x) {
+		return __atomic_load_n(&x, __ATOMIC_ACQUIRE);
+	}
+
+	static uint32_t Random(uint32_t &state) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	bool FindTask(Worker &w, Task &task) {
+		if (w.deque.Pop(task))
+			return true;
+
+		auto count = Load(_count);
+		auto start = Random(w.seed) % count;
+
+		for (uint32_t i = 0; i < count; ++i) {
+			auto &victim = _workers[(start + i) % count];
+
+			if (&victim != &w && victim.deque.Steal(task)) {
+				w.stats.steals += 1;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	bool HasWork() const {
+		auto count = Load(_count);
+
+		for (uint32_t i = 0; i < count; ++i) {
+			if (!_workers[i].deque.IsEmpty())
+				return true;
+		}
+
+		return false;
+	}
+
+	void Run(Worker &w, const Task &task) {
+		auto *job = task.job;
+		auto lo = task.begin;
+		auto hi = task.end;
+
+		while ((hi - lo) > job->grain) {
+			auto mid = lo + (hi - lo) / 2;
+
+			if (!w.deque.Push(Task{job, mid, hi}))
+				break;
+
+			WakeOne();
+			hi = mid;
+		}
+
+		job->invoke(job->fn, lo, hi);
+		w.stats.tasks += 1;
+
+		// must be the last access, the job is gone once this hits 0
+		AtomicFetchAdd(&job->remaining, -(hi - lo));
+	}
+
+	void WakeOne() {
+		// pairs with the fence in Idle, so a wakeup cannot get lost
+		AtomicFence();
+
+		if (Load(_sleepers) == 0)
+			return;
+
+		auto count = Load(_count);
+
+		for (uint32_t i = 0; i < count; ++i) {
+			auto &w = _workers[i];
+
+			if (!Load(w.sleeping) ||
+			    !AtomicCompareExchange(&w.sleeping, 1, 0)) {
+				continue;
+			}
+
+			AtomicFetchAdd(&_sleepers, -1);
+
+			if (!_mwait)
+				_apic->SendInterrupt(w.apicId, WakeupVector);
+			return;
+		}
+	}
+
+	void Idle(Worker &w) {
+		__atomic_store_n(&w.sleeping, 1, __ATOMIC_RELAXED);
+		AtomicFetchAdd(&_sleepers, 1);
+
+		if (!HasWork()) {
+			w.stats.sleeps += 1;
+
+			if (_mwait) {
+				__asm__ __volatile__("monitor"
+						     : : "a"(&w.sleeping),
+						       "c"(0), "d"(0));
+
+				if (Load(w.sleeping))
+					__asm__ __volatile__("mwait"
+							     : : "a"(0), "c"(0));
+			} else {
+				// an IPI that is already pending ends the HLT,
+				// the CPU might run with interrupts enabled
+				__asm__ __volatile__("pushfl\n\t"
+						     "sti\n\t"
+						     "hlt\n\t"
+						     "popfl" : : : "memory", "cc");
+			}
+		}
+
+		// nobody woke us up, or there was work after all
+		if (AtomicCompareExchange(&w.sleeping, 1, 0))
+			AtomicFetchAdd(&_sleepers, -1);
+	}
+
+	Worker _workers[MaxCpus]{};
+	volatile uint32_t _count = 0;
+	volatile uint32_t _sleepers = 0;
+	LocalApic *_apic = nullptr;
+	bool _mwait = false;
+};
+
+#endif /* SCHEDULER_H */
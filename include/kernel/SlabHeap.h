@@ -0,0 +1,261 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * SlabHeap.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef SLAB_HEAP_H
+#define SLAB_HEAP_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "kernel/PageAllocator.h"
+
+/*
+  Kernel object allocator with power of two size classes.
+
+  Each size class has its own slabs. A slab is a single page that starts
+  with a cache line sized header, followed by objects of the same size.
+  Objects are thus aligned to their size, or to a cache line if they are
+  bigger than that, and never straddle more cache lines than necessary.
+
+  Slabs with free objects are kept on a doubly linked list per class, the
+  free objects of a slab on a singly linked list inside the objects. Fresh
+  slabs are carved up lazily, so allocating and freeing is O(1). One empty
+  slab per class is kept around, to not bounce pages back and forth with
+  the page allocator.
+
+  Anything bigger than the largest class gets its own block of pages, also
+  with a header in front, so Free can tell the two cases apart.
+*/
+class SlabHeap {
+public:
+	static constexpr size_t CacheLine = 64;
+	static constexpr size_t MinSize = 16;
+	static constexpr size_t NumClasses = 7;
+	static constexpr size_t MaxSize = MinSize << (NumClasses - 1);
+
+	// per class counters, index NumClasses is for the page sized blocks
+	struct Stats {
+		uint32_t allocs;
+		uint32_t frees;
+		uint32_t failed;
+		uint32_t objects;
+		uint32_t pages;
+	};
+
+	void Init(PageAllocator *pages) {
+		_pages = pages;
+	}
+
+	void *Alloc(size_t size) {
+		if (size > MaxSize)
+			return AllocLarge(size);
+
+		auto idx = ClassIndex(size);
+		auto &stats = _stats[idx];
+		auto *slab = _partial[idx];
+
+		if (slab == nullptr) {
+			slab = _spare[idx];
+			_spare[idx] = nullptr;
+
+			if (slab == nullptr)
+				slab = NewSlab(idx);
+
+			if (slab == nullptr) {
+				stats.failed += 1;
+				return nullptr;
+			}
+
+			Push(slab);
+		}
+
+		void *obj = slab->freeList;
+
+		if (obj != nullptr) {
+			slab->freeList = *((void **)obj);
+		} else {
+			obj = (char *)(slab + 1) + slab->bump * ClassSize(idx);
+			slab->bump += 1;
+		}
+
+		slab->inUse += 1;
+
+		if (slab->inUse == ObjectsPerSlab(idx))
+			Unlink(slab);
+
+		stats.allocs += 1;
+		stats.objects += 1;
+		return obj;
+	}
+
+	void Free(void *ptr) {
+		if (ptr == nullptr)
+			return;
+
+		auto page = (uintptr_t)ptr & ~(PageAllocator::PageSize - 1);
+		auto *slab = (Slab *)page;
+
+		if (slab->magic != Magic)
+			return;
+
+		if (slab->sizeClass == NumClasses) {
+			FreeLarge(slab);
+			return;
+		}
+
+		auto idx = slab->sizeClass;
+		bool wasFull = slab->inUse == ObjectsPerSlab(idx);
+
+		*((void **)ptr) = slab->freeList;
+		slab->freeList = ptr;
+		slab->inUse -= 1;
+
+		_stats[idx].frees += 1;
+		_stats[idx].objects -= 1;
+
+		if (wasFull)
+			Push(slab);
+
+		if (slab->inUse > 0)
+			return;
+
+		Unlink(slab);
+
+		if (_spare[idx] == nullptr) {
+			slab->freeList = nullptr;
+			slab->bump = 0;
+			_spare[idx] = slab;
+		} else {
+			slab->magic = 0;
+			_pages->Free(slab);
+			_stats[idx].pages -= 1;
+		}
+	}
+
+	const Stats &ClassStats(size_t idx) const {
+		return _stats[idx];
+	}
+
+	static size_t ClassSize(size_t idx) {
+		return MinSize << idx;
+	}
+private:
+	static constexpr uint32_t Magic = 0x51AB51AB;
+
+	struct alignas(CacheLine) Slab {
+		Slab *next;
+		Slab *prev;
+		void *freeList;
+		uint32_t magic;
+		uint16_t sizeClass;
+		uint16_t order;
+		uint16_t inUse;
+		uint16_t bump;
+	};
+
+	static_assert(sizeof(Slab) == CacheLine);
+
+	static size_t ClassIndex(size_t size) {
+		if (size <= MinSize)
+			return 0;
+
+		return (32 - __builtin_clz((uint32_t)size - 1)) - 4;
+	}
+
+	static uint16_t ObjectsPerSlab(size_t idx) {
+		return (PageAllocator::PageSize - sizeof(Slab)) / ClassSize(idx);
+	}
+
+	Slab *NewSlab(size_t idx) {
+		auto *slab = (Slab *)_pages->Alloc(0);
+
+		if (slab == nullptr)
+			return nullptr;
+
+		slab->next = nullptr;
+		slab->prev = nullptr;
+		slab->freeList = nullptr;
+		slab->magic = Magic;
+		slab->sizeClass = idx;
+		slab->order = 0;
+		slab->inUse = 0;
+		slab->bump = 0;
+
+		_stats[idx].pages += 1;
+		return slab;
+	}
+
+	void Push(Slab *slab) {
+		auto &head = _partial[slab->sizeClass];
+
+		slab->prev = nullptr;
+		slab->next = head;
+
+		if (head != nullptr)
+			head->prev = slab;
+
+		head = slab;
+	}
+
+	void Unlink(Slab *slab) {
+		if (slab->prev != nullptr) {
+			slab->prev->next = slab->next;
+		} else {
+			_partial[slab->sizeClass] = slab->next;
+		}
+
+		if (slab->next != nullptr)
+			slab->next->prev = slab->prev;
+
+		slab->next = nullptr;
+		slab->prev = nullptr;
+	}
+
+	void *AllocLarge(size_t size) {
+		auto &stats = _stats[NumClasses];
+		unsigned order = 0;
+
+		while (order <= PageAllocator::MaxOrder &&
+		       (PageAllocator::PageSize << order) - sizeof(Slab) < size) {
+			++order;
+		}
+
+		auto *slab = order <= PageAllocator::MaxOrder ?
+			(Slab *)_pages->Alloc(order) : nullptr;
+
+		if (slab == nullptr) {
+			stats.failed += 1;
+			return nullptr;
+		}
+
+		slab->magic = Magic;
+		slab->sizeClass = NumClasses;
+		slab->order = order;
+
+		stats.allocs += 1;
+		stats.objects += 1;
+		stats.pages += 1U << order;
+		return slab + 1;
+	}
+
+	void FreeLarge(Slab *slab) {
+		auto &stats = _stats[NumClasses];
+
+		stats.frees += 1;
+		stats.objects -= 1;
+		stats.pages -= 1U << slab->order;
+
+		slab->magic = 0;
+		_pages->Free(slab, slab->order);
+	}
+
+	PageAllocator *_pages = nullptr;
+	Slab *_partial[NumClasses]{};
+	Slab *_spare[NumClasses]{};
+	Stats _stats[NumClasses + 1]{};
+};
+
+#endif /* SLAB_HEAP_H */
@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * WorkDeque.h
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#ifndef WORK_DEQUE_H
+#define WORK_DEQUE_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "kernel/Atomic.h"
+
+/*
+  Chase-Lev work stealing deque, with a fixed size ring buffer.
+
+  The owning CPU pushes and pops at the bottom, any other CPU can steal
+  from the top. Only taking the last element and stealing need a CAS, the
+  rest is plain loads and stores, plus one full fence in Pop (x86 only
+  reorders stores with later loads).
+
+  Elements are copied in and out by value. A thief may read an element
+  that is being overwritten, but then its CAS on the top index fails,
+  because the owner only reuses a slot after the top moved past it.
+*/
+template<typename T, size_t CAPACITY>
+class WorkDeque {
+public:
+	static_assert((CAPACITY & (CAPACITY - 1)) == 0);
+
+	// Owner only, fails if the deque is full
+	bool Push(const T &value) {
+		auto b = Load(_bottom);
+		auto t = __atomic_load_n(&_top, __ATOMIC_ACQUIRE);
+
+		if ((b - t) >= CAPACITY)
+			return false;
+
+		_ring[b % CAPACITY] = value;
+		__atomic_store_n(&_bottom, b + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	// Owner only
+	bool Pop(T &out) {
+		auto b = Load(_bottom) - 1;
+
+		__atomic_store_n(&_bottom, b, __ATOMIC_RELAXED);
+		AtomicFence();
+
+		auto t = Load(_top);
+
+		if ((int32_t)(b - t) < 0) {
+			__atomic_store_n(&_bottom, b + 1, __ATOMIC_RELAXED);
+			return false;
+		}
+
+		out = _ring[b % CAPACITY];
+
+		if (b != t)
+			return true;
+
+		// last element, race against the thieves for it
+		bool won = AtomicCompareExchange(&_top, t, t + 1);
+
+		__atomic_store_n(&_bottom, b + 1, __ATOMIC_RELAXED);
+		return won;
+	}
+
+	// Any CPU, fails if empty or if another CPU was faster
+	bool Steal(T &out) {
+		auto t = __atomic_load_n(&_top, __ATOMIC_ACQUIRE);
+		auto b = __atomic_load_n(&_bottom, __ATOMIC_ACQUIRE);
+
+		if ((int32_t)(b - t) <= 0)
+			return false;
+
+		out = _ring[t % CAPACITY];
+		return AtomicCompareExchange(&_top, t, t + 1);
+	}
+
+	bool IsEmpty() const {
+		auto t = __atomic_load_n(&_top, __ATOMIC_ACQUIRE);
+		auto b = __atomic_load_n(&_bottom, __ATOMIC_ACQUIRE);
+
+		return (int32_t)(b - t) <= 0;
+	}
+private:
+	static uint32_t Load(const volatile uint32_t &x) {
+		return __atomic_load_n(&x, __ATOMIC_RELAXED);
+	}
+
+	// top and bottom on separate cache lines, thieves only touch top
+	alignas(64) volatile uint32_t _top = 0;
+	alignas(64) volatile uint32_t _bottom = 0;
+	alignas(64) T _ring[CAPACITY]{};
+};
+
+#endif /* WORK_DEQUE_H */
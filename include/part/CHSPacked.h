@@ -35,6 +35,11 @@ public:
 		_mid = (_mid & 0x3F) | ((value >> 2) & 0xC0);
 		_hi = value & 0xFF;
 	}
+
+	// Sector and cylinder, already in the layout INT 13h expects in CX
+	uint16_t SectorCylinder() const {
+		return (static_cast<uint16_t>(_hi) << 8) | _mid;
+	}
 private:
 	uint8_t _lo = 0;
 	uint8_t _mid = 0;
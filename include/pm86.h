@@ -8,19 +8,36 @@
 #define PM86_H
 
 #include <cstddef>
-#include <utility>
-
-// Try to enable the A20 line by various means and test if it worked
-extern bool EnableA20();
 
+#if __STDC_HOSTED__
+// Host builds (e.g. the test harness) link mock helpers and call them directly
+template<typename F, typename... Args>
+int RealModeCall(F func, Args... args)
+{
+	return func(args...);
+}
+#else
 extern "C" {
 	/*
-	  Switch to protected mode, call a 32 bit function with possible
-	  arguments and switch back into 16 bit real-mode before returning.
+	  Switch from 32 bit protected mode back to real-mode, call a 16 bit
+	  function with possible arguments and return its result after
+	  switching back into protected mode.
+
+	  The stack must be below 64k. Buffers handed to the BIOS itself
+	  must be addressable through real-mode segments.
 	*/
-	void ProtectedModeCall(...);
+	int RealModeCall(...);
 }
+#endif
+
+/*
+  Picks the fastest way to copy and clear memory on this CPU. Enables SSE
+  in CR0/CR4 if the CPU has SSE2. Before this is called, both functions
+  work on any 386.
+*/
+void InitMemoryOps();
 
+// Handles overlapping buffers, like memmove
 void CopyMemory32(void *dst, const void *src, size_t count);
 
 void ClearMemory32(void *dst, size_t size);
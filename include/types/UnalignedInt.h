@@ -29,20 +29,29 @@ public:
 	}
 
 	T Read() const {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		// a plain (unaligned) load, instead of a byte loop
+		T out;
+		__builtin_memcpy(&out, _raw, sizeof(T));
+#else
 		size_t i = 0;
 		T out = 0;
 
 		for (auto x : _raw)
-			out |= x << (8 * (i++));
-
+			out |= (T)x << (8 * (i++));
+#endif
 		return out;
 	}
 
 	void Set(T value) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		__builtin_memcpy(_raw, &value, sizeof(T));
+#else
 		for (size_t i = 0; i < sizeof(T); ++i) {
 			_raw[i] = value & 0x0FF;
 			value >>= 8;
 		}
+#endif
 	}
 private:
 	uint8_t _raw[sizeof(T)];
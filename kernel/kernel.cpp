@@ -5,14 +5,92 @@
  * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
  */
 #include "kernel/MultiBootInfo.h"
-#include "device/VideoMemory.h"
+#include "kernel/PhysRangeList.h"
+#include "kernel/PageAllocator.h"
+#include "kernel/SlabHeap.h"
+#include "kernel/PageDirectory.h"
+#include "kernel/Cpu.h"
+#include "kernel/CacheControl.h"
+#include "kernel/LocalApic.h"
+#include "kernel/PerCpu.h"
+#include "kernel/MpTable.h"
+#include "kernel/Acpi.h"
+#include "kernel/Idt.h"
+#include "kernel/Scheduler.h"
+#include "kernel/LogConsole.h"
+#include "kernel/Benchmark.h"
+#include "kernel/Profiler.h"
+#include "device/Pit.h"
+#include "device/DebugCon.h"
+#include "device/Pic.h"
+#include "device/VgaConsole.h"
+#include "device/SerialPort.h"
 #include "device/TextScreen.h"
+#include "device/MemoryBlockDevice.h"
+#include "fs/FatFs.h"
+#include "Memory.h"
+#include "pm86.h"
 
 extern "C" {
 	void multiboot_main(const MultiBootInfo *info, uint32_t signature);
+	void ap_main(PerCpu *self);
+	void timer_tick(uint32_t eip);
+
+	// abi.S
+	extern const char ap_trampoline[];
+	extern const char ap_trampoline_end[];
+	extern ApBootParams ap_boot;
+	extern volatile uint32_t *lapic_eoi;
+	void wakeup_isr();
+	void spurious_isr();
+	void timer_isr();
+
+	// kernel.ld
+	extern char __start_text[];
+	extern char __stop_text[];
+	extern char __stop_bss[];
 };
 
-static void PrintMemoryMap(TextScreen<VideoMemory>& s,
+// too big for the kernel stack, must not need a constructor either
+static VgaConsole vga;
+static SerialPort serial;
+static TextScreen<LogConsole> s;
+
+// physical memory that is free for use, before the page allocator exists
+static PhysRangeList<64> ranges;
+static PageAllocator pages;
+static PageDirectory pageDir;
+static SlabHeap heap;
+static CpuId cpu;
+static CacheControl cache;
+
+static constexpr size_t MaxCpus = Scheduler::MaxCpus;
+static_assert(MaxCpus <= LogConsole::MaxCpus);
+static_assert(MaxCpus <= Profiler::MaxCpus);
+static constexpr unsigned ApStackOrder = 2;
+
+static LocalApic lapic;
+static Idt idt;
+static Scheduler sched;
+static PerCpu *cpus[MaxCpus];
+static size_t cpuCount = 0;
+static uint64_t trampolinePage = 0;
+
+// the first FAT image passed in as a module
+static FatFs *moduleFs = nullptr;
+
+// backend for the operator new/delete in Memory.h
+void *malloc(size_t count)
+{
+	return heap.Alloc(count);
+}
+
+void free(void *ptr)
+{
+	heap.Free(ptr);
+}
+
+static void PrintMemoryMap(TextScreen<LogConsole>& s,
 			   const MultiBootInfo *info)
 {
 	const auto *mmap = info->MemoryMapBegin();
@@ -47,12 +125,624 @@ static void PrintMemoryMap(TextScreen<VideoMemory>& s,
 	}
 }
 
-void multiboot_main(const MultiBootInfo *info, uint32_t signature)
+static void Reserve(uint64_t start, uint64_t end)
+{
+	if (end < start)
+		end = 0xFFFF'FFFF'FFFF'FFFF;
+
+	ranges.Remove(ranges.AlignDown(start, PageAllocator::PageSize),
+		      ranges.AlignUp(end, PageAllocator::PageSize));
+}
+
+static void Reserve(const void *ptr, size_t size)
+{
+	Reserve((uintptr_t)ptr, (uint64_t)(uintptr_t)ptr + size);
+}
+
+static void ReserveString(const char *str)
+{
+	if (str == nullptr)
+		return;
+
+	size_t len = 0;
+
+	while (str[len] != '\0')
+		++len;
+
+	Reserve(str, len + 1);
+}
+
+static bool InitFreeRanges(const MultiBootInfo *info)
+{
+	const auto *mmap = info->MemoryMapBegin();
+	const auto *mmapEnd = info->MemoryMapEnd();
+
+	if (mmap == nullptr || mmapEnd == nullptr)
+		return false;
+
+	// The E820 map can be unsorted, overlapping and not page aligned.
+	// Merge the usable ranges first, then cut out everything else.
+	for (auto *it = mmap; it < mmapEnd; it = it->Next()) {
+		if (it->Type() != MemoryMapEntry::MemType::Usable)
+			continue;
+
+		uint64_t start = it->BaseAddress();
+		uint64_t end = start + it->Size();
+
+		if (start >= PageAllocator::Limit)
+			continue;
+
+		if (end < start || end > PageAllocator::Limit)
+			end = PageAllocator::Limit;
+
+		ranges.Add(start, end);
+	}
+
+	ranges.Align(PageAllocator::PageSize);
+
+	for (auto *it = mmap; it < mmapEnd; it = it->Next()) {
+		if (it->Type() != MemoryMapEntry::MemType::Usable)
+			Reserve(it->BaseAddress(), it->BaseAddress() + it->Size());
+	}
+
+	// real mode IVT and BIOS data area, also keeps nullptr invalid
+	Reserve(0, PageAllocator::PageSize);
+
+	// the kernel itself and everything the boot loader passed to it
+	Reserve(__start_text, __stop_bss - __start_text);
+	Reserve(info, sizeof(*info));
+	Reserve(mmap, (const char *)mmapEnd - (const char *)mmap);
+	ReserveString(info->CommandLine());
+	ReserveString(info->BootLoaderName());
+
+	const auto *mod = info->ModulesBegin();
+	const auto *modEnd = info->ModulesEnd();
+
+	if (mod != nullptr && modEnd != nullptr) {
+		Reserve(mod, (const char *)modEnd - (const char *)mod);
+
+		for (; mod < modEnd; ++mod) {
+			Reserve(mod->Start(), mod->End());
+			ReserveString(mod->String());
+		}
+	}
+
+	return ranges.Count() > 0;
+}
+
+/*
+  Boot time bump allocator, that takes zeroed pages from the front of the
+  free ranges. Low memory is scarce and needed for other things, so it is
+  only used if there is nothing left above 1M.
+*/
+static void *BootAlloc(size_t size)
+{
+	size = ranges.AlignUp(size, PageAllocator::PageSize);
+
+	auto addr = ranges.TakeFront(size, 0x100000);
+	if (addr == 0)
+		addr = ranges.TakeFront(size, 0);
+
+	if (addr == 0)
+		return nullptr;
+
+	auto *ptr = (void *)(uintptr_t)addr;
+
+	ClearMemory32(ptr, size);
+	return ptr;
+}
+
+static void *AllocPageTable()
+{
+	auto *ptr = BootAlloc(PageDirectory::PageSize);
+
+	// the page allocator takes over once the boot time one is done
+	if (ptr == nullptr && (ptr = pages.Alloc(0)) != nullptr)
+		ClearMemory32(ptr, PageDirectory::PageSize);
+
+	return ptr;
+}
+
+static bool InitPaging(const MultiBootInfo *info)
+{
+	// too big for the kernel stack
+	static PhysRangeList<64> mapped;
+
+	// BIOS area and video memory, then everything the firmware knows of
+	mapped.Add(0, 0x100000);
+
+	for (auto *it = info->MemoryMapBegin(); it < info->MemoryMapEnd();
+	     it = it->Next()) {
+		if (it->Type() == MemoryMapEntry::MemType::Broken)
+			continue;
+
+		uint64_t start = it->BaseAddress();
+		uint64_t end = start + it->Size();
+
+		if (end < start)
+			end = PageDirectory::Limit;
+
+		mapped.Add(mapped.AlignDown(start, PageDirectory::PageSize),
+			   mapped.AlignUp(end, PageDirectory::PageSize));
+	}
+
+	mapped.Add((uintptr_t)__start_text, (uintptr_t)__stop_bss);
+
+	if (!pageDir.Init(AllocPageTable, cpu.Has(CpuId::Feature::PSE)))
+		return false;
+
+	for (const auto &r : mapped) {
+		if (!pageDir.Map(r.start, r.end, {PageDirectory::Flag::Writable}))
+			return false;
+	}
+
+	// text mode VRAM, only ever written to by the VgaConsole
+	if (cache.NeedsMapping() &&
+	    !pageDir.Map(0xB8000, 0xC0000, {PageDirectory::Flag::Writable,
+					     CacheControl::WriteCombining})) {
+		return false;
+	}
+
+	pageDir.Activate();
+	return true;
+}
+
+static bool InitPageAllocator()
 {
-	TextScreen<VideoMemory> s;
+	auto limit = ranges.HighestAddress();
+	auto *meta = BootAlloc(PageAllocator::MetadataSize(limit));
+
+	if (meta == nullptr)
+		return false;
+
+	pages.Init(meta, limit);
+
+	for (const auto &r : ranges)
+		pages.AddRange(r.start, r.end);
+
+	// everything belongs to the page allocator now
+	ranges = PhysRangeList<64>{};
+	return true;
+}
+
+/*
+  A module with a FAT32 file system in it is used straight from memory, the
+  FatFs windows point into the image. The words after the module path on
+  its command line name files to look up, e.g.:
+    module BOOT/INITFS.IMG CONFIG.TXT BIN/INIT
+*/
+static FatFs *MountModule(const MultiBootModule &mod)
+{
+	auto *super = (const FatSuper *)(uintptr_t)mod.Start();
+	size_t size = mod.End() - mod.Start();
+
+	if (size < sizeof(*super) || !super->HasBootSignature() ||
+	    super->BytesPerSector() != 512 ||
+	    super->SectorsPerCluster() == 0 || super->SectorsPerFat() == 0 ||
+	    super->RootDirIndex() < 2) {
+		return nullptr;
+	}
+
+	UniquePtr<IBlockDevice> blk(new MemoryBlockDevice(super, size));
+	if (blk == nullptr)
+		return nullptr;
+
+	return new FatFs(std::move(blk), *super);
+}
+
+static void ShowModuleFiles(FatFs &fs, const char *args)
+{
+	char path[64];
+
+	// skip the module path
+	while (*args != '\0' && !IsSpace(*args))
+		++args;
+
+	for (;;) {
+		while (IsSpace(*args))
+			++args;
+
+		if (*args == '\0')
+			break;
+
+		size_t len = 0;
+
+		while (*args != '\0' && !IsSpace(*args)) {
+			if (len < sizeof(path) - 1)
+				path[len++] = *args;
+			++args;
+		}
+
+		path[len] = '\0';
+
+		FatFile finfo;
+
+		if (fs.FindByPath(path, finfo) != FatFs::FindResult::Ok) {
+			s << "  " << path << ": not found" << "\r\n";
+			continue;
+		}
+
+		// count the physically contiguous pieces
+		uint32_t offset = 0, extents = 0;
+
+		while (offset < finfo.size) {
+			uint32_t size = finfo.size - offset;
+
+			if (fs.MapAt(finfo, offset, size) == nullptr)
+				break;
+
+			offset += size;
+			extents += 1;
+		}
+
+		s << "  " << path << ": " << finfo.size << " bytes, "
+		  << extents << " extents" << "\r\n";
+	}
+}
+
+static void MountModules(const MultiBootInfo *info)
+{
+	const auto *mod = info->ModulesBegin();
+	const auto *modEnd = info->ModulesEnd();
+
+	if (mod == nullptr || modEnd == nullptr)
+		return;
+
+	for (; mod < modEnd && moduleFs == nullptr; ++mod) {
+		moduleFs = MountModule(*mod);
+
+		if (moduleFs == nullptr)
+			continue;
+
+		s << "Mounted " << mod->String() << " ("
+		  << (mod->End() - mod->Start()) << " bytes)" << "\r\n";
+
+		ShowModuleFiles(*moduleFs, mod->String());
+	}
+}
+
+// Collects the APIC IDs of all CPUs, from the ACPI MADT or the MP tables
+static size_t FindCpus(uint8_t *ids, size_t max, uint64_t &apicBase)
+{
+	size_t count = 0;
+
+	auto add = [&](uint8_t id) {
+		if (count < max)
+			ids[count++] = id;
+	};
+
+	const auto *rsdp = AcpiRsdp::Find();
+	const auto *sdt = rsdp != nullptr ? rsdp->FindTable("APIC") : nullptr;
+
+	if (sdt != nullptr) {
+		AcpiMadt madt(sdt);
+
+		apicBase = madt.LocalApicAddress();
+		madt.ForEachCpu(add);
+		return count;
+	}
+
+	const auto *mp = MpFloatingPointer::Find();
+	const auto *table = mp != nullptr ? mp->ConfigTable() : nullptr;
+
+	if (table != nullptr) {
+		apicBase = table->LocalApicAddress();
+		table->ForEachCpu(add);
+	}
+
+	return count;
+}
+
+// INIT-SIPI-SIPI sequence from the MultiProcessor Specification
+static bool StartCpu(PerCpu *ap)
+{
+	auto *stack = (char *)pages.Alloc(ApStackOrder);
+
+	if (stack == nullptr)
+		return false;
 
-	s.Driver().SetColor(VideoMemory::Color::White,
-			    VideoMemory::Color::Blue);
+	ap_boot.cr3 = ReadCr3();
+	ap_boot.cr4 = cpu.Has(CpuId::Feature::PSE) ? ReadCr4() : 0;
+	ap_boot.stack = (uintptr_t)stack +
+		(PageAllocator::PageSize << ApStackOrder);
+	ap_boot.cpu = ap;
+
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	if (!lapic.SendInit(ap->ApicId()))
+		return false;
+
+	PitDelay(10000);
+
+	for (int i = 0; i < 2 && !ap->IsOnline(); ++i) {
+		if (!lapic.SendStartup(ap->ApicId(), trampolinePage >> 12))
+			return false;
+
+		PitDelay(200);
+	}
+
+	for (int i = 0; i < 100 && !ap->IsOnline(); ++i)
+		PitDelay(1000);
+
+	// On failure, the stack is leaked on purpose. The AP might still
+	// show up late and use it, before it sees that it was abandoned.
+	return ap->IsOnline() || !ap->Abandon();
+}
+
+#ifdef HAUSBOOT_KERNEL_PROFILE
+/*
+  Sampling profiler, driven by the local APIC timer of every CPU, or by PIT
+  channel 0 on the boot CPU only, if there is no APIC.
+*/
+static constexpr uint32_t ProfileHz = 1000;
+static constexpr uint8_t PicVectorBase = 0x20;
+static constexpr uint8_t ApicTimerVector = 0xE0;
+
+static Profiler profiler;
+static uint32_t apicTimerCount = 0;
+
+void timer_tick(uint32_t eip)
+{
+	profiler.Sample(PerCpu::Current()->Index(), eip);
+
+	if (apicTimerCount > 0) {
+		lapic.EndOfInterrupt();
+	} else {
+		PicEndOfInterrupt(0);
+	}
+}
+
+static void InitProfiler(bool haveApic)
+{
+	profiler.Init((uintptr_t)__start_text, (uintptr_t)__stop_text);
+
+	// the vectors the BIOS set up collide with CPU exceptions
+	PicRemap(PicVectorBase, PicVectorBase + 8);
+	idt.SetGate(PicVectorBase + 7, spurious_isr);
+	idt.SetGate(PicVectorBase + 15, spurious_isr);
+
+	if (haveApic) {
+		auto ticks = lapic.MeasureTimer([] { PitDelay(10000); });
+
+		apicTimerCount = ticks * 100 / ProfileHz;
+		idt.SetGate(ApicTimerVector, timer_isr);
+	} else {
+		uint16_t divisor = 1193182 / ProfileHz;
+
+		// channel 0, lobyte/hibyte, rate generator
+		IoWriteByte(0x43, 0x34);
+		IoWriteByte(0x40, divisor & 0xFF);
+		IoWriteByte(0x40, divisor >> 8);
+
+		idt.SetGate(PicVectorBase, timer_isr);
+		PicUnmask(0);
+	}
+
+	profiler.SetEnabled(true);
+}
+
+// On every CPU, once the profiler has a histogram for it
+static void StartProfileTimer()
+{
+	if (apicTimerCount > 0)
+		lapic.StartTimer(ApicTimerVector, apicTimerCount);
+
+	__asm__ __volatile__("sti");
+}
+
+// bypasses the log ring, which would overflow
+struct DebugOutput {
+	void PutChar(uint8_t c) {
+		DebugCon::PutChar(c);
+		serial.PutChar(c);
+	}
+};
+
+static void DumpProfile()
+{
+	TextScreen<DebugOutput> out;
+
+	__asm__ __volatile__("cli");
+	profiler.SetEnabled(false);
+	profiler.Dump(out);
+}
+#endif
+
+static void StartCpus()
+{
+	uint64_t apicBase = LocalApic::DefaultBase;
+	uint8_t ids[MaxCpus];
+	size_t count = 0;
+
+	if (cpu.Has(CpuId::Feature::APIC))
+		count = FindCpus(ids, MaxCpus, apicBase);
+
+	// static, so that single CPU mode works even without a heap
+	alignas(64) static PerCpu bspCpu;
+	auto *bsp = &bspCpu;
+
+	if (count == 0 || apicBase >= PageDirectory::Limit ||
+	    !pageDir.Map(apicBase, apicBase + PageDirectory::PageSize,
+			 {PageDirectory::Flag::Writable,
+			  PageDirectory::Flag::WriteThrough,
+			  PageDirectory::Flag::CacheDisable})) {
+		bsp->Init(0, 0);
+		count = 0;
+	} else {
+		lapic.Init(apicBase);
+		lapic.Enable();
+		lapic_eoi = lapic.EoiRegister();
+		bsp->Init(0, lapic.Id());
+	}
+
+	idt.SetGate(Scheduler::WakeupVector, wakeup_isr);
+	idt.SetGate(0xFF, spurious_isr);
+	idt.Load();
+
+	bsp->LoadGdt();
+	bsp->Release();
+	cpus[cpuCount++] = bsp;
+
+	sched.Init(&lapic, cpu.Has(CpuId::FeatureEcx::Monitor));
+	sched.AddCpu(bsp->Index(), bsp->ApicId());
+
+#ifdef HAUSBOOT_KERNEL_PROFILE
+	InitProfiler(count > 0);
+
+	if (profiler.AddCpu(bsp->Index()))
+		StartProfileTimer();
+#endif
+
+	if (count < 2 || trampolinePage == 0)
+		return;
+
+	// from here on, the log needs locked instructions
+	s.Driver().SetMultiCpu();
+
+	CopyMemory32((void *)(uintptr_t)trampolinePage, ap_trampoline,
+		     ap_trampoline_end - ap_trampoline);
+
+	for (size_t i = 0; i < count; ++i) {
+		if (ids[i] == bsp->ApicId())
+			continue;
+
+		auto *ap = new PerCpu;
+
+		if (ap == nullptr)
+			break;
+
+		ap->Init(cpuCount, ids[i]);
+
+		// A late AP still reads ap_boot, so it must not be reused
+		if (!StartCpu(ap)) {
+			s << "CPU with APIC ID " << (uint32_t)ids[i]
+			  << " did not start, not starting any more" << "\r\n";
+			break;
+		}
+
+		sched.AddCpu(ap->Index(), ap->ApicId());
+#ifdef HAUSBOOT_KERNEL_PROFILE
+		profiler.AddCpu(ap->Index());
+#endif
+		cpus[cpuCount++] = ap;
+		ap->Release();
+	}
+}
+
+void ap_main(PerCpu *self)
+{
+	cache.SetupCpu();
+	self->LoadGdt();
+	idt.Load();
+	lapic.Enable();
+
+	if (!self->SetOnline()) {
+		for (;;)
+			__asm__ ("cli\n\thlt");
+	}
+
+	self->WaitReleased();
+
+#ifdef HAUSBOOT_KERNEL_PROFILE
+	StartProfileTimer();
+#endif
+	sched.WorkerLoop(self->Index());
+}
+
+// Spreads a dummy loop over all CPUs and shows who did how much
+static void TestScheduler()
+{
+	static uint32_t counts[MaxCpus];
+
+	sched.ParallelFor(0, 4096, 16, [](uint32_t) {
+		counts[PerCpu::Current()->Index()] += 1;
+	});
+
+	s << "Parallel for:";
+
+	for (size_t i = 0; i < cpuCount; ++i) {
+		auto &stats = sched.CpuStats(i);
+
+		s << " " << counts[i] << "/" << stats.tasks << "/"
+		  << stats.steals;
+	}
+
+	s << " (indices/tasks/steals)" << "\r\n";
+}
+
+#ifdef HAUSBOOT_KERNEL_BENCH
+static void BenchSlab(uint32_t count)
+{
+	while (count--)
+		heap.Free(heap.Alloc(64));
+}
+
+static void BenchPages(uint32_t count)
+{
+	while (count--)
+		pages.Free(pages.Alloc(0));
+}
+
+static void BenchCopy(uint32_t count)
+{
+	static char src[4096], dst[4096];
+
+	while (count--)
+		CopyMemory32(dst, src, sizeof(dst));
+}
+
+static void BenchClear(uint32_t count)
+{
+	static char buffer[65536];
+
+	while (count--)
+		ClearMemory32(buffer, sizeof(buffer));
+}
+
+static void BenchLogLine(uint32_t count)
+{
+	static LogRing<4096> ring;
+	static const char line[] = "The quick brown fox jumps over the lazy "
+		"dog, 0123456789ABCDEF\r\n";
+
+	while (count--) {
+		ring.Write(line, sizeof(line) - 1);
+		ring.Drain([](const char *, size_t) {});
+	}
+}
+
+KERNEL_BENCHMARK(slab_alloc_free_64, BenchSlab, 64, 4, 256);
+KERNEL_BENCHMARK(page_alloc_free, BenchPages, 64, 4, 256);
+KERNEL_BENCHMARK(copy_4k, BenchCopy, 4, 4, 256);
+KERNEL_BENCHMARK(clear_64k, BenchClear, 1, 4, 64);
+KERNEL_BENCHMARK(log_line, BenchLogLine, 64, 4, 256);
+
+// results go to the debug port and to the log (screen and serial port)
+struct BenchOutput {
+	void PutChar(uint8_t c) {
+		DebugCon::PutChar(c);
+		s.PutChar(c);
+	}
+};
+
+static void RunBenchmarks()
+{
+	static BenchmarkRunner runner;
+	TextScreen<BenchOutput> out;
+
+	if (!cpu.Has(CpuId::Feature::TSC) || !runner.Calibrate()) {
+		s << "No TSC, cannot run benchmarks" << "\r\n";
+		return;
+	}
+
+	runner.RunAll(out);
+}
+#endif
+
+void multiboot_main(const MultiBootInfo *info, uint32_t signature)
+{
+	vga.SetColor(VgaConsole::Color::White, VgaConsole::Color::Blue);
+	s.Driver().Init(&vga, &serial);
 	s.Reset();
 
 	s << "Hello 32 bit world!" << "\r\n";
@@ -67,7 +757,82 @@ void multiboot_main(const MultiBootInfo *info, uint32_t signature)
 	s << "High memory: " << info->HighMemoryCount() << "k" << "\r\n";
 
 	PrintMemoryMap(s, info);
+	s.Flush();
+
+	cpu.Load();
+	InitMemoryOps();
+
+	cache.Init(cpu);
+	cache.SetupCpu();
+
+	if (!InitFreeRanges(info)) {
+		s << "No usable memory found!" << "\r\n";
+		goto fail;
+	}
+
+	// the startup IPI can only point to a page below 1M
+	if (ranges.Count() > 0 && ranges.begin()->start < 0x100000)
+		trampolinePage = ranges.TakeFront(PageAllocator::PageSize, 0);
+
+	s.Flush();
+
+	if (!InitPaging(info)) {
+		s << "Cannot set up page tables!" << "\r\n";
+		goto fail;
+	}
+
+	s << "Paging: " << (uint32_t)pageDir.LargePageCount()
+	  << " large pages, " << (uint32_t)pageDir.TableCount()
+	  << " page tables" << "\r\n";
+
+	switch (cache.Type()) {
+	case CacheControl::Method::Pat:
+		s << "Video memory: write combining (PAT)" << "\r\n";
+		break;
+	case CacheControl::Method::Mtrr:
+		s << "Video memory: write combining (MTRR)" << "\r\n";
+		break;
+	default:
+		break;
+	}
+
+	if (!InitPageAllocator()) {
+		s << "Cannot set up the page allocator!" << "\r\n";
+		goto fail;
+	}
+
+	heap.Init(&pages);
+
+	s << "Free memory: " << (uint32_t)(pages.FreePages() * 4) << "k"
+	  << "\r\n";
+
+	s.Flush();
+	MountModules(info);
+
+	s.Flush();
+	StartCpus();
+
+	s << "CPUs online: " << (uint32_t)cpuCount << "\r\n";
+
+	TestScheduler();
+#ifdef HAUSBOOT_KERNEL_BENCH
+	RunBenchmarks();
+#endif
 fail:
+	s.Flush();
+
+	if (s.Driver().Dropped() > 0) {
+		s << "Log lines dropped: " << s.Driver().Dropped() << "\r\n";
+		s.Flush();
+	}
+
+#ifdef HAUSBOOT_KERNEL_PROFILE
+	DumpProfile();
+#endif
+#if defined(HAUSBOOT_KERNEL_BENCH) || defined(HAUSBOOT_KERNEL_PROFILE)
+	DebugCon::Exit(0);
+#endif
+
 	for (;;)
 		__asm__ ("hlt");
 }
@@ -6,6 +6,7 @@
  */
 #include "device/PS2Controller.h"
 #include "device/SysCtrl.h"
+#include "BIOS/BiosCall.h"
 
 static bool TestA20()
 {
@@ -30,7 +31,7 @@ static bool TestA20()
 	return false;
 }
 
-bool EnableA20()
+static bool EnableA20()
 {
 	for (int i = 0; i < 256; ++i) {
 		if (TestA20())
@@ -63,3 +64,8 @@ bool EnableA20()
 
 	return false;
 }
+
+int BiosEnableA20()
+{
+	return EnableA20();
+}
@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * disk.cpp
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "BIOS/BiosCall.h"
+
+int BiosDiskReadGeometry(uint32_t drive, BiosDisk::DriveGeometry *out)
+{
+	return BiosDisk(drive).ReadDriveParameters(*out);
+}
+
+int BiosDiskHasExtensions(uint32_t drive)
+{
+	return BiosDisk(drive).HasExtensions();
+}
+
+int BiosDiskReadParametersExt(uint32_t drive,
+			      BiosDisk::DriveParametersExt *out)
+{
+	return BiosDisk(drive).ReadDriveParametersExt(*out);
+}
+
+int BiosDiskLoadLBA(uint32_t drive, uint32_t lba, void *out, uint32_t count)
+{
+	return BiosDisk(drive).LoadSectorsLBA(lba, out, count);
+}
+
+int BiosDiskLoadCHS(uint32_t drive, const BiosDisk::DriveGeometry *geometry,
+		    uint32_t lba, void *out)
+{
+	return BiosDisk(drive).LoadSectors(geometry->LBA2CHS(lba), out, 1);
+}
@@ -0,0 +1,20 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * video.cpp
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "BIOS/BIOSTextMode.h"
+#include "BIOS/BiosCall.h"
+
+int BiosVideoReset()
+{
+	BIOSTextMode().Reset();
+	return 1;
+}
+
+int BiosVideoPutChar(uint32_t c)
+{
+	BIOSTextMode().PutChar(c);
+	return 1;
+}
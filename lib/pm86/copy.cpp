@@ -4,34 +4,255 @@
  *
  * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
  */
+#include "kernel/Cpu.h"
 #include "pm86.h"
 
-__asm__ (".code32");
+#include <cstdint>
+
+/*
+  Until InitMemoryOps is called, copies use REP MOVSD, which every 386 has.
+  With fast string support (ERMSB), REP MOVSB is used for everything. Without
+  it, but with SSE2, larger buffers are moved 128 bits at a time instead.
+
+  With SSE2, buffers that do not fit into the last level cache are written
+  with non-temporal stores, so they do not throw out everything else on the
+  way.
+*/
+enum class CopyMethod : uint8_t {
+	Dwords,
+	Bytes,
+	Vector,
+};
+
+// below this, the setup of the SSE loop does not pay off against REP MOVSD
+static constexpr size_t VectorThreshold = 256;
+
+static CopyMethod method = CopyMethod::Dwords;
+static size_t streamThreshold = ~(size_t)0;
+
+static size_t LastLevelCacheSize(const CpuId &cpu)
+{
+	uint32_t regs[4];
+	size_t size = 0;
+
+	// deterministic cache parameters, one sub leaf per cache (Intel)
+	for (uint32_t i = 0; cpu.MaxLeaf() >= 4 && i < 8; ++i) {
+		CpuId::Query(4, i, regs);
+
+		if ((regs[0] & 0x1F) == 0)
+			break;
+
+		size_t ways = (regs[1] >> 22) + 1;
+		size_t parts = ((regs[1] >> 12) & 0x3FF) + 1;
+		size_t line = (regs[1] & 0xFFF) + 1;
+		size_t sets = regs[2] + 1;
+
+		if ((ways * parts * line * sets) > size)
+			size = ways * parts * line * sets;
+	}
+
+	if (size > 0)
+		return size;
+
+	// L2 and L3 size from the extended leaves (AMD)
+	CpuId::Query(0x80000000, 0, regs);
+
+	if (regs[0] < 0x80000006 || regs[0] > 0x8000FFFF)
+		return 0;
+
+	CpuId::Query(0x80000006, 0, regs);
+
+	size = (regs[3] >> 18) * 512 * 1024;
+	if (size == 0)
+		size = (regs[2] >> 16) * 1024;
+
+	return size;
+}
+
+void InitMemoryOps()
+{
+	CpuId cpu;
+
+	cpu.Load();
+
+	if (cpu.Has(CpuId::FeatureExt::ERMSB))
+		method = CopyMethod::Bytes;
+
+	if (cpu.Has(CpuId::Feature::FXSR) && cpu.Has(CpuId::Feature::SSE2)) {
+		auto cache = LastLevelCacheSize(cpu);
+
+		// SSE instructions fault, unless the OS says it saves them
+		WriteCr0((ReadCr0() & ~Cr0Emulation) | Cr0MonitorCoproc);
+		WriteCr4(ReadCr4() | Cr4OsFxsr);
+
+		streamThreshold = cache > 0 ? cache : 0x100000;
+
+		if (method == CopyMethod::Dwords)
+			method = CopyMethod::Vector;
+	}
+}
+
+static void CopyForward(void *dst, const void *src, size_t count)
+{
+	if (method == CopyMethod::Bytes) {
+		__asm__ __volatile__("rep movsb"
+				     : "+D"(dst), "+S"(src), "+c"(count)
+				     : : "memory");
+		return;
+	}
+
+	size_t dwords = count / 4;
+
+	__asm__ __volatile__("rep movsl\n\t"
+			     "movl %3, %%ecx\n\t"
+			     "rep movsb"
+			     : "+D"(dst), "+S"(src), "+c"(dwords)
+			     : "r"(count & 3)
+			     : "memory");
+}
+
+// only called once InitMemoryOps found SSE2
+__attribute__((target("sse2")))
+static void CopyVector(char *dst, const char *src, size_t count, bool stream)
+{
+	// align the destination, the source may stay unaligned
+	size_t head = -(uintptr_t)dst & 0x0F;
+
+	CopyForward(dst, src, head);
+	dst += head;
+	src += head;
+	count -= head;
+
+	for (; stream && count >= 64; count -= 64, dst += 64, src += 64) {
+		__asm__ __volatile__("movdqu (%1), %%xmm0\n\t"
+				     "movdqu 16(%1), %%xmm1\n\t"
+				     "movdqu 32(%1), %%xmm2\n\t"
+				     "movdqu 48(%1), %%xmm3\n\t"
+				     "movntdq %%xmm0, (%0)\n\t"
+				     "movntdq %%xmm1, 16(%0)\n\t"
+				     "movntdq %%xmm2, 32(%0)\n\t"
+				     "movntdq %%xmm3, 48(%0)"
+				     : : "r"(dst), "r"(src)
+				     : "xmm0", "xmm1", "xmm2", "xmm3",
+				       "memory");
+	}
+
+	for (; count >= 64; count -= 64, dst += 64, src += 64) {
+		__asm__ __volatile__("movdqu (%1), %%xmm0\n\t"
+				     "movdqu 16(%1), %%xmm1\n\t"
+				     "movdqu 32(%1), %%xmm2\n\t"
+				     "movdqu 48(%1), %%xmm3\n\t"
+				     "movdqa %%xmm0, (%0)\n\t"
+				     "movdqa %%xmm1, 16(%0)\n\t"
+				     "movdqa %%xmm2, 32(%0)\n\t"
+				     "movdqa %%xmm3, 48(%0)"
+				     : : "r"(dst), "r"(src)
+				     : "xmm0", "xmm1", "xmm2", "xmm3",
+				       "memory");
+	}
+
+	if (stream)
+		__asm__ __volatile__("sfence" : : : "memory");
+
+	CopyForward(dst, src, count);
+}
 
 void CopyMemory32(void *dst, const void *src, size_t count)
 {
 	if (dst == src || count == 0)
 		return;
 
-	if (dst < src) {
-		auto *d = (char *)dst;
-		auto *s = (char *)src;
+	auto *d = (char *)dst;
+	auto *s = (const char *)src;
+	bool disjoint = (d + count) <= s || (s + count) <= d;
+
+	if (disjoint && count >= streamThreshold) {
+		CopyVector(d, s, count, true);
+		return;
+	}
+
+	// every 64 byte block is loaded before it is stored, so a
+	// destination below the source cannot overwrite unread data
+	if (d < s || disjoint) {
+		if (method == CopyMethod::Vector && count >= VectorThreshold) {
+			CopyVector(d, s, count, false);
+		} else {
+			CopyForward(d, s, count);
+		}
+		return;
+	}
+
+	// overlapping, with the destination above the source
+	d += count - 1;
+	s += count - 1;
+
+	__asm__ __volatile__("std\n\t"
+			     "rep movsb\n\t"
+			     "cld"
+			     : "+D"(d), "+S"(s), "+c"(count)
+			     : : "memory", "cc");
+}
 
-		while (count--)
-			*(d++) = *(s++);
-	} else {
-		auto *d = (char *)dst + count - 1;
-		auto *s = (char *)src + count - 1;
+__attribute__((target("sse2")))
+static size_t ClearVector(char *dst, size_t size, bool stream)
+{
+	for (; stream && size >= 64; size -= 64, dst += 64) {
+		__asm__ __volatile__("pxor %%xmm0, %%xmm0\n\t"
+				     "movntdq %%xmm0, (%0)\n\t"
+				     "movntdq %%xmm0, 16(%0)\n\t"
+				     "movntdq %%xmm0, 32(%0)\n\t"
+				     "movntdq %%xmm0, 48(%0)"
+				     : : "r"(dst) : "xmm0", "memory");
+	}
 
-		while (count--)
-			*(d--) = *(s--);
+	for (; size >= 64; size -= 64, dst += 64) {
+		__asm__ __volatile__("pxor %%xmm0, %%xmm0\n\t"
+				     "movdqa %%xmm0, (%0)\n\t"
+				     "movdqa %%xmm0, 16(%0)\n\t"
+				     "movdqa %%xmm0, 32(%0)\n\t"
+				     "movdqa %%xmm0, 48(%0)"
+				     : : "r"(dst) : "xmm0", "memory");
 	}
+
+	if (stream)
+		__asm__ __volatile__("sfence" : : : "memory");
+
+	return size;
 }
 
 void ClearMemory32(void *dst, size_t size)
 {
-	auto *ptr = (char *)dst;
+	auto *d = (char *)dst;
+
+	bool stream = size >= streamThreshold;
+
+	if (stream || (method == CopyMethod::Vector &&
+		       size >= VectorThreshold)) {
+		size_t head = -(uintptr_t)d & 0x0F;
+
+		ClearMemory32(d, head);
+		d += head;
+		size -= head;
+
+		auto tail = ClearVector(d, size, stream);
+
+		d += size - tail;
+		size = tail;
+	}
+
+	if (method == CopyMethod::Bytes) {
+		__asm__ __volatile__("rep stosb"
+				     : "+D"(d), "+c"(size)
+				     : "a"(0) : "memory");
+		return;
+	}
+
+	size_t dwords = size / 4;
 
-	while (size--)
-		*(ptr++) = 0x00;
+	__asm__ __volatile__("rep stosl\n\t"
+			     "movl %2, %%ecx\n\t"
+			     "rep stosb"
+			     : "+D"(d), "+c"(dwords)
+			     : "r"(size & 3), "a"(0)
+			     : "memory");
 }
@@ -33,8 +33,11 @@ void main(BiosDisk disk)
 		if (!disk.Reset())
 			DumpMessageAndHang(msgResetDrv);
 
-		if (!disk.LoadSectors(it.StartAddressCHS(), bootSector, 1))
+		// CHS is only the fallback, if the INT 13h extensions fail
+		if (!disk.LoadSectorsLBA(it.StartAddressLBA(), bootSector, 1) &&
+		    !disk.LoadSectors(it.StartAddressCHS(), bootSector, 1)) {
 			DumpMessageAndHang(msgFailLoad);
+		}
 
 		if (bootSector[255] != 0xAA55)
 			DumpMessageAndHang(msgNoMagic);
@@ -9,6 +9,9 @@
 
 #include <cstdint>
 
+// 4 on the i386 target, but lets the heap also be built for host tests
+constexpr size_t HeapAlign = sizeof(void *);
+
 struct HeapEntry {
 	enum class HeapFlags {
 		Reserved = 0x01,
@@ -35,7 +38,7 @@ struct HeapEntry {
 		if (!IsFree() || (count > sz))
 			return nullptr;
 
-		if ((sz - count) >= (sizeof(*this) + 4)) {
+		if ((sz - count) >= (sizeof(*this) + HeapAlign)) {
 			HeapEntry *ent = (HeapEntry *)((char *)DataPtr() + count);
 			ent->Init(_next);
 			_next = ent;
@@ -74,15 +77,15 @@ private:
 	FlagField<HeapFlags, uint32_t> _flags;
 };
 
-static_assert(sizeof(HeapEntry) == 8);
+static_assert(sizeof(HeapEntry) == 2 * sizeof(void *));
 
 static HeapEntry *heap;
 static HeapEntry *heapEnd;
 
 void HeapInit(void *basePtr, size_t maxSize)
 {
-	if (maxSize % 4)
-		maxSize -= maxSize % 4;
+	if (maxSize % HeapAlign)
+		maxSize -= maxSize % HeapAlign;
 
 	heap = (HeapEntry *)basePtr;
 	heapEnd = (HeapEntry *)((char *)heap + maxSize);
@@ -92,8 +95,8 @@ void HeapInit(void *basePtr, size_t maxSize)
 
 void *malloc(size_t count)
 {
-	if (count % 4)
-		count += 4 - (count % 4);
+	if (count % HeapAlign)
+		count += HeapAlign - (count % HeapAlign);
 
 	HeapEntry *found = nullptr;
 
@@ -4,13 +4,16 @@
  *
  * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
  */
-#include "BIOS/BIOSTextMode.h"
+#include "BIOS/BIOSTextMode32.h"
 #include "BIOS/MemoryMap.h"
 #include "BIOS/BIOSBlockDevice.h"
-#include "kernel/MultiBootHeader.h"
+#include "BIOS/BiosCall.h"
 #include "kernel/MultiBootInfo.h"
+#include "kernel/MultiBootModule.h"
+#include "device/ReadAheadBlockDevice.h"
 #include "device/IBlockDevice.h"
 #include "device/TextScreen.h"
+#include "device/DebugCon.h"
 #include "types/UniquePtr.h"
 #include "fs/FatDirentLong.h"
 #include "fs/FatDirent.h"
@@ -18,6 +21,8 @@
 #include "fs/FatName.h"
 #include "fs/FatFs.h"
 #include "Stage2Header.h"
+#include "BootLoader.h"
+#include "BootScript.h"
 #include "StringUtil.h"
 #include "pm86.h"
 
@@ -27,34 +32,53 @@ static auto *stage2header = (Stage2Header *)headerBlob;
 
 static const char *bootConfigName = "BOOT.CFG";
 static constexpr size_t bootConfigMaxSize = 4096;
-static constexpr size_t multiBootMaxSearch = 8192;
-static constexpr size_t heapMaxSize = 8192;
+static constexpr uint16_t readAheadMaxSectors = 32;
+static constexpr uint32_t loadChunkSize = 0x10000;
 
-static TextScreen<BIOSTextMode> screen;
+// the heap covers conventional memory, well below the EBDA
+static auto *heapStart = (char *)0x10000;
+static auto *heapEnd = (char *)0x80000;
+
+// BIOS transfers to memory it cannot reach go through here
+static auto *bounceBuffer = (void *)0x8000;
+static constexpr size_t bounceBufferSize = 0x8000;
+
+static constexpr size_t readAheadPoolSize = 0x8000;
+
+// stage2 runs identity mapped, physical addresses are pointers
+struct PhysMemory {
+	static uint8_t *Map(uint32_t address, uint32_t size) {
+		(void)size;
+		return (uint8_t *)address;
+	}
+};
+
+static TextScreen<BIOSTextMode32> screen;
 static MemoryMap<32> mmap;
 static UniquePtr<FatFs> fs;
+static const BIOSBlockDevice *bootDisk = nullptr;
+static ReadAheadBlockDevice *readAhead = nullptr;
 
-static bool haveKernel = false;
-static void *kernelEntry = nullptr;
+static BootLoader<TextScreen<BIOSTextMode32>, PhysMemory> loader;
+static MultiBootModule modules[decltype(loader)::MaxModules];
 
-template<class T>
-static TextScreen<T> &operator<< (TextScreen<T> &s, FatFs::FindResult type)
+// Phase markers for the Qemu benchmark, see test/qemubench.py
+static void BenchMark(const char *phase)
 {
-	const char *str = "no such file or directory";
-
-	switch (type) {
-	case FatFs::FindResult::Ok: str = "ok"; break;
-	case FatFs::FindResult::NameInvalid: str = "name invalid"; break;
-	case FatFs::FindResult::IOError: str = "I/O error"; break;
-	case FatFs::FindResult::NotDir:
-		str = "component is not a directory";
-		break;
-	default:
-		break;
-	}
+#ifdef HAUSBOOT_BENCH
+	DebugCon::Mark(phase);
+#else
+	(void)phase;
+#endif
+}
 
-	s << str;
-	return s;
+static void BenchExit(uint8_t code)
+{
+#ifdef HAUSBOOT_BENCH
+	DebugCon::Exit(code);
+#else
+	(void)code;
+#endif
 }
 
 template<class T>
@@ -75,92 +99,6 @@ static TextScreen<T> &operator<< (TextScreen<T> &s,
 
 /*****************************************************************************/
 
-static bool MBFindHeader(const FatFile &finfo, uint32_t &offset,
-			 MultiBootHeader &hdr)
-{
-	auto scanSize = finfo.size > multiBootMaxSearch ?
-		multiBootMaxSearch : finfo.size;
-
-	auto *buffer = (uint32_t *)malloc(1024);
-	if (buffer == nullptr) {
-		screen << "out of memory" << "\r\n";
-		return false;
-	}
-
-	for (offset = 0; offset < scanSize; ) {
-		auto ret = fs->ReadAt(finfo, (uint8_t *)buffer, offset, 1024);
-		if (ret <= 0)
-			goto fail;
-
-		for (decltype(ret) i = 0; i < (ret / 4); ++i) {
-			if (((uint32_t *)buffer)[i] != MultiBootHeader::Magic)
-				continue;
-
-			ret = fs->ReadAt(finfo, (uint8_t *)&hdr,
-					 offset + i * 4, sizeof(hdr));
-			if (ret <= 0)
-				goto fail;
-
-			if (hdr.IsValid()) {
-				offset += i * 4;
-				free(buffer);
-				return true;
-			}
-		}
-
-		offset += ret;
-	}
-fail:
-	free(buffer);
-	return false;
-}
-
-static bool MBLoadKernel(const FatFile &finfo, const MultiBootHeader &hdr,
-			 uint32_t fileOffset)
-{
-	uint32_t fileStart, memStart, count;
-
-	if (!hdr.ExtractMemLayout(fileOffset, finfo.size, fileStart,
-				  memStart, count)) {
-		screen << "Error: " << "Memory layout is broken!" << "\r\n";
-		return false;
-	}
-
-	// TODO: check if target actually is in high-mem
-	// TODO: check if we have enough memory available there
-
-	// load it into memory
-	screen << "Loading " << count << " bytes to #";
-	screen.WriteHex(memStart);
-	screen << "\r\n";
-
-	uint8_t *buffer = (uint8_t *)malloc(1024);
-	if (buffer == nullptr) {
-		screen << "out of memory" << "\r\n";
-		return false;
-	}
-
-	for (auto offset = fileStart; offset < (count - fileStart); ) {
-		auto ret = fs->ReadAt(finfo, buffer, offset, 1024);
-
-		if (ret == 0)
-			break;
-
-		if (ret < 0)
-			return false;
-
-		ProtectedModeCall(CopyMemory32, (void *)memStart, buffer, ret);
-
-		memStart += ret;
-		offset += ret;
-	}
-
-	free(buffer);
-
-	ProtectedModeCall(ClearMemory32, (void *)memStart, hdr.BSSSize());
-	return true;
-}
-
 static MultiBootInfo *MBGenInfo()
 {
 	auto *info = new MultiBootInfo();
@@ -176,6 +114,18 @@ static MultiBootInfo *MBGenInfo()
 	}
 
 	info->SetMemoryMap(mbMmap, count);
+
+	count = loader.ModuleCount();
+
+	for (size_t i = 0; i < count; ++i) {
+		const auto &mod = loader.ModuleAt(i);
+
+		modules[i].Set(mod.start, mod.end, mod.string);
+	}
+
+	if (count > 0)
+		info->SetModules(modules, count);
+
 	return info;
 }
 
@@ -194,12 +144,15 @@ static bool CmdEcho(const char *line)
 static bool CmdInfo(const char *what)
 {
 	if (StrEqual(what, "disk")) {
-		auto geom = ((const BIOSBlockDevice &)fs->BlockDevice()).DriveGeometry();
+		const auto &blk = *bootDisk;
+		auto geom = blk.DriveGeometry();
 		auto lba = stage2header->BootMBREntry().StartAddressLBA();
 		auto chs = geom.LBA2CHS(lba);
 
 		screen << "Boot disk: " << "\r\n"
 		       << "    geometry (C/H/S): " << geom << "\r\n"
+		       << "    sector size: " << (uint32_t)blk.SectorSize()
+		       << (blk.HaveLBA() ? " (LBA)" : " (CHS)") << "\r\n"
 		       << "Boot partition: " << "\r\n"
 		       << "    LBA: " << lba << "\r\n"
 		       << "    CHS: " << chs << "\r\n";
@@ -207,6 +160,20 @@ static bool CmdInfo(const char *what)
 		return true;
 	}
 
+	if (StrEqual(what, "readahead")) {
+		const auto &stats = readAhead->Stats();
+
+		screen << "Read-ahead:" << "\r\n"
+		       << "    window: " << (uint32_t)stats.depth
+		       << "/" << (uint32_t)stats.maxDepth << " sectors" << "\r\n"
+		       << "    hits: " << stats.hits
+		       << ", misses: " << stats.misses << "\r\n"
+		       << "    prefetched: " << stats.prefetched
+		       << " sectors in " << stats.prefetches
+		       << " requests" << "\r\n";
+		return true;
+	}
+
 	if (StrEqual(what, "memory")) {
 		screen << "Memory:" << "\r\n";
 
@@ -227,131 +194,86 @@ static bool CmdInfo(const char *what)
 
 static bool CmdMultiboot(const char *path)
 {
-	FatFile finfo;
-
-	auto ret = fs->FindByPath(path, finfo);
-	if (ret != FatFs::FindResult::Ok) {
-		screen << path << ": " << ret << "\r\n";
+	if (!loader.CmdMultiboot(path))
 		return false;
-	}
 
-	uint32_t offset;
-	MultiBootHeader hdr;
+	BenchMark("kernel");
+	return true;
+}
 
-	if (!MBFindHeader(finfo, offset, hdr)) {
-		screen << "Error: " << "No multiboot header found!" << "\r\n";
-		return false;
-	}
+static bool CmdVerify(const char *arg)
+{
+	return loader.CmdVerify(arg);
+}
 
-	if (hdr.Flags().IsSet(MultiBootHeader::KernelFlags::WantVidmode)) {
-		screen << "Error: "
-		       << "video mode info required (unsupported)!" << "\r\n";
+static bool CmdModule(const char *arg)
+{
+	if (!loader.CmdModule(arg))
 		return false;
-	}
 
-	if (!hdr.Flags().IsSet(MultiBootHeader::KernelFlags::HaveLayoutInfo)) {
-		screen << "Error: "
-		       << "No memory layout provided (unsupported)!" << "\r\n";
+	BenchMark("module");
+	return true;
+}
+
+static bool CmdLinux(const char *arg)
+{
+	if (!loader.CmdLinux(arg))
 		return false;
-	}
 
-	if (!MBLoadKernel(finfo, hdr, offset))
+	BenchMark("kernel");
+	return true;
+}
+
+static bool CmdInitrd(const char *path)
+{
+	if (!loader.CmdInitrd(path))
 		return false;
 
-	haveKernel = true;
-	kernelEntry = hdr.EntryPoint();
+	BenchMark("initrd");
 	return true;
 }
 
-static const struct {
-	const char *name;
-	bool (*callback)(const char *arg);
-} commands[] = {
+static const BootCommand commands[] = {
 	{ "echo", CmdEcho },
 	{ "info", CmdInfo },
+	{ "initrd", CmdInitrd },
+	{ "linux", CmdLinux },
+	{ "module", CmdModule },
 	{ "multiboot", CmdMultiboot },
+	{ "verify", CmdVerify },
 };
 
-static void RunScript(char *ptr)
-{
-	while (*ptr != '\0') {
-		// isolate the current line
-		char *line = ptr;
-
-		while (*ptr != '\0' && *ptr != '\n')
-			++ptr;
-
-		if (*ptr == '\n')
-			*(ptr++) = '\0';
-
-		// isolate command string
-		while (*line == ' ' || *line == '\t')
-			++line;
-
-		if (!IsAlnum(*line))
-			continue;
-
-		const char *cmd = line;
-
-		while (IsAlnum(*line))
-			++line;
-
-		if (!IsSpace(*line) || *cmd == '\0' || *cmd == '#')
-			continue;
-
-		*(line++) = '\0';
-
-		while (IsSpace(*line))
-			++line;
-
-		const char *arg = line;
-
-		// dispatch
-		bool found = false;
-
-		for (const auto &it : commands) {
-			if (StrEqual(it.name, cmd)) {
-				if (!it.callback(arg))
-					return;
-				found = true;
-				break;
-			}
-		}
-
-		if (!found) {
-			screen << "Error, unknown command: " << cmd << "\r\n";
-			return;
-		}
-	}
-}
-
 /*****************************************************************************/
 
 extern "C" {
-	void main(void *heapPtr);
+	void main();
 }
 
-void main(void *heapPtr)
+void main()
 {
 	FatFs::FindResult ret;
+	const char *unknownCmd;
 	char *fileBuffer;
 	FatFile finfo;
 	int32_t rdRet;
 
 	// initialization
-	HeapInit(heapPtr, heapMaxSize);
+	BenchMark("stage2");
+	HeapInit(heapStart, heapEnd - heapStart);
+	InitMemoryOps();
 
 	screen.Reset();
 
 	auto part = MakeUnique<BIOSBlockDevice>(stage2header->BiosBootDrive(),
-						stage2header->BootMBREntry().StartAddressLBA());
+						stage2header->BootMBREntry().StartAddressLBA(),
+						bounceBuffer, bounceBufferSize);
 
 	if (part == nullptr || !part->IsInitialized()) {
 		screen << "Error initializing FAT partition wrapper!" << "\r\n";
 		goto fail;
 	}
 
-	if (!EnableA20()) {
+	if (!RealModeCall(BiosEnableA20)) {
 		screen << "Error enabling A20 line!" << "\r\n";
 		goto fail;
 	}
@@ -361,12 +283,31 @@ void main(void *heapPtr)
 		goto fail;
 	}
 
-	fs = MakeUnique<FatFs>(std::move(part), *((FatSuper *)0x7C00));
+	if (((FatSuper *)0x7C00)->BytesPerSector() != part->SectorSize()) {
+		screen << "FAT sector size does not match the disk!" << "\r\n";
+		goto fail;
+	}
+
+	bootDisk = &(*part);
+	readAhead = new ReadAheadBlockDevice(std::move(part),
+					     readAheadMaxSectors,
+					     malloc(readAheadPoolSize),
+					     readAheadPoolSize);
+	if (readAhead == nullptr) {
+		screen << "Error initializing read-ahead wrapper!" << "\r\n";
+		goto fail;
+	}
+
+	fs = MakeUnique<FatFs>(UniquePtr<IBlockDevice>(readAhead),
+			       *((FatSuper *)0x7C00));
 	if (fs == nullptr) {
 		screen << "Error initializing FAT FS wrapper!" << "\r\n";
 		goto fail;
 	}
 
+	loader.Init(&screen, &(*fs), &mmap, loadChunkSize);
+	BenchMark("init");
+
 	// find the boot loader config file
 	ret = fs->FindByPath(bootConfigName, finfo);
 	if (ret != FatFs::FindResult::Ok) {
@@ -390,21 +331,36 @@ void main(void *heapPtr)
 	}
 
 	fileBuffer[rdRet] = '\0';
+	BenchMark("config");
 
 	// interpret it
-	RunScript(fileBuffer);
+	if (!RunScript(fileBuffer, commands, unknownCmd) && unknownCmd != nullptr)
+		screen << "Error, unknown command: " << unknownCmd << "\r\n";
+
 	free(fileBuffer);
+	BenchMark("script");
 
 	// run the kernel
-	if (haveKernel) {
+	if (loader.HaveLinux()) {
+		BenchMark("boot");
+		BenchExit(0);
+
+		RealModeCall(BiosBootLinux, loader.LinuxSetupAddress >> 4,
+			     loader.LinuxHeapEnd);
+	} else if (loader.HaveKernel()) {
 		auto *info = MBGenInfo();
 
-		ProtectedModeCall(MBTrampoline, kernelEntry, info);
+		BenchMark("boot");
+		BenchExit(0);
+		MBTrampoline(loader.KernelEntry(), info);
 	} else {
 		screen << "No kernel loaded!" << "\r\n";
 		goto fail;
 	}
 fail:
+	BenchMark("fail");
+	BenchExit(1);
+
 	for (;;) {
 		__asm__ volatile("hlt");
 	}
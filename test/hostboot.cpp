@@ -0,0 +1,534 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * hostboot.cpp
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "BIOS/BIOSBlockDevice.h"
+#include "BIOS/MemoryMap.h"
+#include "BIOS/BiosCall.h"
+#include "device/ReadAheadBlockDevice.h"
+#include "device/TextScreen.h"
+#include "fs/FatSuper.h"
+#include "fs/FatFs.h"
+#include "host/File.h"
+#include "BootLoader.h"
+#include "BootScript.h"
+
+#include <sys/stat.h>
+
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <string>
+
+/*
+  Runs the second stage boot logic as a native program, on top of mocked
+  BIOS services. The config commands that load images are the ones from
+  stage2, see BootLoader.h. Disk reads come from an image file, the memory map is
+  made up and everything the boot config loads ends up in a simulated
+  physical address space.
+
+  For every command in the config file, the number of BIOS requests and
+  sectors is reported, as well as the host time. If per-request or
+  per-sector costs are given, a simulated I/O time is reported too.
+*/
+
+static struct {
+	uint32_t partStart = 0;
+	uint16_t sectorSize = 512;
+	bool haveLBA = true;
+	uint32_t requestCost = 0;
+	uint32_t sectorCost = 0;
+	uint32_t memSize = 64;
+	uint16_t readAheadSectors = 32;
+	uint32_t chunkSize = 0x10000;
+	const char *configName = "BOOT.CFG";
+	const char *image = nullptr;
+} options;
+
+/*****************************************************************************/
+
+static File disk;
+static uint64_t diskSectors = 0;
+
+static struct {
+	uint64_t requests = 0;
+	uint64_t sectors = 0;
+} io;
+
+static std::vector<uint8_t> physMem;
+
+static uint8_t *PhysPtr(uint32_t address, uint32_t size)
+{
+	if (address > physMem.size() || size > (physMem.size() - address))
+		return nullptr;
+
+	return physMem.data() + address;
+}
+
+static bool DiskRead(uint32_t lba, void *out, uint32_t count)
+{
+	if (lba >= diskSectors || count > (diskSectors - lba))
+		return false;
+
+	io.requests += 1;
+	io.sectors += count;
+
+	try {
+		disk.ReadAt((uint64_t)lba * options.sectorSize, out,
+			    (size_t)count * options.sectorSize);
+	} catch (std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+int BiosDiskReadGeometry(uint32_t, BiosDisk::DriveGeometry *out)
+{
+	auto cylinders = diskSectors / (255 * 63);
+
+	out->cylinders = cylinders > 1023 ? 1023 : (cylinders + 1);
+	out->headsPerCylinder = 255;
+	out->sectorsPerTrack = 63;
+	return 1;
+}
+
+int BiosDiskHasExtensions(uint32_t)
+{
+	return options.haveLBA;
+}
+
+int BiosDiskReadParametersExt(uint32_t, BiosDisk::DriveParametersExt *out)
+{
+	// the sector size sits at byte offset 24 of the EDD packet
+	auto *raw = (uint8_t *)out;
+
+	memset(raw, 0, sizeof(*out));
+	raw[0] = sizeof(*out);
+	raw[24] = options.sectorSize & 0xFF;
+	raw[25] = options.sectorSize >> 8;
+	return 1;
+}
+
+int BiosDiskLoadLBA(uint32_t, uint32_t lba, void *out, uint32_t count)
+{
+	return DiskRead(lba, out, count);
+}
+
+int BiosDiskLoadCHS(uint32_t, const BiosDisk::DriveGeometry *,
+		    uint32_t lba, void *out)
+{
+	return DiskRead(lba, out, 1);
+}
+
+int IntCallE820(uint32_t *ebxInOut, uint8_t dst[20])
+{
+	const struct {
+		uint64_t base;
+		uint64_t size;
+		uint32_t type;
+	} table[] = {
+		{ 0x00000000, 0x0009FC00, 1 },
+		{ 0x0009FC00, 0x00000400, 2 },
+		{ 0x000F0000, 0x00010000, 2 },
+		{ 0x00100000, (options.memSize - 1) * 0x100000ULL, 1 },
+	};
+	constexpr uint32_t count = sizeof(table) / sizeof(table[0]);
+
+	if (*ebxInOut >= count)
+		return 1;
+
+	memcpy(dst, &table[*ebxInOut].base, 8);
+	memcpy(dst + 8, &table[*ebxInOut].size, 8);
+	memcpy(dst + 16, &table[*ebxInOut].type, 4);
+
+	*ebxInOut += 1;
+	if (*ebxInOut >= count)
+		*ebxInOut = 0;
+	return 0;
+}
+
+void CopyMemory32(void *dst, const void *src, size_t count)
+{
+	memcpy(dst, src, count);
+}
+
+void ClearMemory32(void *dst, size_t size)
+{
+	memset(dst, 0, size);
+}
+
+/*****************************************************************************/
+
+// messages of the shared loader code go to stdout
+class HostConsole {
+public:
+	void PutChar(uint8_t c) {
+		if (c != '\r')
+			std::cout.put(c);
+	}
+};
+
+// physical addresses point into the simulated memory
+struct SimMemory {
+	static uint8_t *Map(uint32_t address, uint32_t size) {
+		return PhysPtr(address, size);
+	}
+};
+
+static MemoryMap<32> mmap;
+static UniquePtr<FatFs> fs;
+static const BIOSBlockDevice *bootDisk = nullptr;
+static ReadAheadBlockDevice *readAhead = nullptr;
+static TextScreen<HostConsole> screen;
+static BootLoader<TextScreen<HostConsole>, SimMemory> loader;
+
+static void PrintCost(uint64_t requests, uint64_t sectors, double host)
+{
+	std::cout << "requests: " << requests << ", sectors: " << sectors
+		  << std::fixed << std::setprecision(3);
+
+	// there is no sensible default for the disk speed
+	if (options.requestCost > 0 || options.sectorCost > 0) {
+		double sim = (requests * options.requestCost +
+			      sectors * options.sectorCost) / 1000.0;
+
+		std::cout << ", simulated: " << sim << " ms";
+	}
+
+	std::cout << ", host: " << host << " ms" << std::endl;
+}
+
+// Reports the I/O and time spent by a command, once it goes out of scope
+class Probe {
+public:
+	Probe(const char *name, const char *arg) : _name(name), _arg(arg) {
+		_requests = io.requests;
+		_sectors = io.sectors;
+		_start = std::chrono::steady_clock::now();
+	}
+
+	~Probe() {
+		auto end = std::chrono::steady_clock::now();
+		std::chrono::duration<double, std::milli> wall = end - _start;
+
+		std::cout << "  [" << _name << " " << _arg << "] ";
+		PrintCost(io.requests - _requests, io.sectors - _sectors,
+			  wall.count());
+	}
+private:
+	const char *_name;
+	std::string _arg;
+	uint64_t _requests;
+	uint64_t _sectors;
+	std::chrono::steady_clock::time_point _start;
+};
+
+static std::ostream &operator<< (std::ostream &s, FatFs::FindResult ret)
+{
+	switch (ret) {
+	case FatFs::FindResult::Ok: s << "ok"; break;
+	case FatFs::FindResult::NameInvalid: s << "name invalid"; break;
+	case FatFs::FindResult::IOError: s << "I/O error"; break;
+	case FatFs::FindResult::NotDir: s << "component is not a directory"; break;
+	default: s << "no such file or directory"; break;
+	}
+	return s;
+}
+
+static bool FindFile(const char *path, FatFile &finfo)
+{
+	auto ret = fs->FindByPath(path, finfo);
+
+	if (ret != FatFs::FindResult::Ok) {
+		std::cout << path << ": " << ret << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/*****************************************************************************/
+
+static bool CmdEcho(const char *line)
+{
+	Probe probe("echo", "");
+
+	std::cout << line << std::endl;
+	return true;
+}
+
+static bool CmdInfo(const char *what)
+{
+	Probe probe("info", what);
+
+	if (StrEqual(what, "readahead")) {
+		const auto &stats = readAhead->Stats();
+
+		std::cout << "Read-ahead: window " << stats.depth << "/"
+			  << stats.maxDepth << ", hits " << stats.hits
+			  << ", misses " << stats.misses << ", prefetched "
+			  << stats.prefetched << " in " << stats.prefetches
+			  << " requests" << std::endl;
+	} else if (StrEqual(what, "memory")) {
+		for (const auto &it : mmap) {
+			std::cout << "    base: 0x" << std::hex
+				  << it.BaseAddress() << ", size: 0x"
+				  << it.Size() << std::dec << ", type: "
+				  << it.TypeAsString() << std::endl;
+		}
+	} else if (StrEqual(what, "disk")) {
+		std::cout << "    sector size: " << bootDisk->SectorSize()
+			  << (bootDisk->HaveLBA() ? " (LBA)" : " (CHS)")
+			  << std::endl;
+	} else {
+		std::cout << "Unknown info type: " << what << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+static bool CmdVerify(const char *arg)
+{
+	Probe probe("verify", arg);
+
+	return loader.CmdVerify(arg);
+}
+
+static bool CmdMultiboot(const char *path)
+{
+	Probe probe("multiboot", path);
+
+	return loader.CmdMultiboot(path);
+}
+
+static bool CmdModule(const char *arg)
+{
+	Probe probe("module", arg);
+
+	return loader.CmdModule(arg);
+}
+
+static bool CmdLinux(const char *arg)
+{
+	Probe probe("linux", arg);
+
+	return loader.CmdLinux(arg);
+}
+
+static bool CmdInitrd(const char *path)
+{
+	Probe probe("initrd", path);
+
+	return loader.CmdInitrd(path);
+}
+
+static const BootCommand commands[] = {
+	{ "echo", CmdEcho },
+	{ "info", CmdInfo },
+	{ "initrd", CmdInitrd },
+	{ "linux", CmdLinux },
+	{ "module", CmdModule },
+	{ "multiboot", CmdMultiboot },
+	{ "verify", CmdVerify },
+};
+
+/*****************************************************************************/
+
+static void Usage()
+{
+	std::cerr << "Usage: hostboot [OPTIONS...] <image>" << std::endl
+		  << std::endl
+		  << "Runs the stage2 boot config logic against a FAT32 image."
+		  << std::endl << std::endl
+		  << "  --offset <sector>       partition start in the image"
+		  << std::endl
+		  << "  --sector-size <bytes>   disk sector size (512)"
+		  << std::endl
+		  << "  --chs                   pretend the BIOS has no LBA support"
+		  << std::endl
+		  << "  --request-cost <us>     simulated cost of a BIOS request (0)"
+		  << std::endl
+		  << "  --sector-cost <us>      simulated cost per sector (0)"
+		  << std::endl
+		  << "  --memory <MiB>          simulated memory size (64)"
+		  << std::endl
+		  << "  --readahead <sectors>   read-ahead window limit (32)"
+		  << std::endl
+		  << "  --chunk <bytes>         load chunk size (65536)"
+		  << std::endl
+		  << "  --config <path>         config file to run (BOOT.CFG)"
+		  << std::endl;
+}
+
+static bool ParseOptions(int argc, char **argv)
+{
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--chs")) {
+			options.haveLBA = false;
+			continue;
+		}
+
+		if (argv[i][0] != '-') {
+			if (options.image != nullptr)
+				return false;
+			options.image = argv[i];
+			continue;
+		}
+
+		if ((i + 1) >= argc) {
+			std::cerr << "Missing argument for `" << argv[i]
+				  << "`" << std::endl;
+			return false;
+		}
+
+		const char *arg = argv[++i];
+		auto value = strtoul(arg, nullptr, 0);
+
+		if (!strcmp(argv[i - 1], "--offset")) {
+			options.partStart = value;
+		} else if (!strcmp(argv[i - 1], "--sector-size")) {
+			options.sectorSize = value;
+		} else if (!strcmp(argv[i - 1], "--request-cost")) {
+			options.requestCost = value;
+		} else if (!strcmp(argv[i - 1], "--sector-cost")) {
+			options.sectorCost = value;
+		} else if (!strcmp(argv[i - 1], "--memory")) {
+			options.memSize = value;
+		} else if (!strcmp(argv[i - 1], "--readahead")) {
+			options.readAheadSectors = value;
+		} else if (!strcmp(argv[i - 1], "--chunk")) {
+			options.chunkSize = value;
+		} else if (!strcmp(argv[i - 1], "--config")) {
+			options.configName = arg;
+		} else {
+			std::cerr << "Unknown option `" << argv[i - 1] << "`"
+				  << std::endl;
+			return false;
+		}
+	}
+
+	if (options.image == nullptr || options.sectorSize < 512 ||
+	    (options.sectorSize & (options.sectorSize - 1)) != 0 ||
+	    options.memSize < 2 || options.memSize > 3072 ||
+	    options.chunkSize == 0) {
+		return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	struct stat sb;
+
+	if (!ParseOptions(argc, argv)) {
+		Usage();
+		return EXIT_FAILURE;
+	}
+
+	try {
+		disk = File(options.image, true);
+	} catch (std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (stat(options.image, &sb) != 0) {
+		perror(options.image);
+		return EXIT_FAILURE;
+	}
+
+	diskSectors = sb.st_size / options.sectorSize;
+	physMem.resize((size_t)options.memSize * 0x100000);
+
+	auto start = std::chrono::steady_clock::now();
+
+	// same stack as stage2: BIOS disk, read-ahead, FAT
+	std::vector<uint8_t> bounce(0x8000);
+	std::vector<uint8_t> pool(0x8000);
+	FatSuper super;
+
+	auto part = MakeUnique<BIOSBlockDevice>(BiosDisk(0x80),
+						options.partStart,
+						bounce.data(), bounce.size());
+	if (!part->IsInitialized()) {
+		std::cerr << "Error initializing disk" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (!mmap.Load()) {
+		std::cerr << "Error loading memory map" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::vector<uint8_t> first(part->SectorSize());
+	if (!part->LoadSector(0, first.data())) {
+		std::cerr << "Error reading the FAT super block" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	memcpy(&super, first.data(), sizeof(super));
+
+	if (super.BytesPerSector() != part->SectorSize()) {
+		std::cerr << "FAT sector size does not match the disk!"
+			  << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	bootDisk = &(*part);
+	readAhead = new ReadAheadBlockDevice(std::move(part),
+					     options.readAheadSectors,
+					     pool.data(), pool.size());
+	fs = MakeUnique<FatFs>(UniquePtr<IBlockDevice>(readAhead), super);
+	loader.Init(&screen, &(*fs), &mmap, options.chunkSize);
+
+	// load and run the config file
+	FatFile finfo;
+	std::string config;
+
+	{
+		Probe probe("config", options.configName);
+
+		if (!FindFile(options.configName, finfo))
+			return EXIT_FAILURE;
+
+		config.resize(finfo.size);
+
+		auto ret = fs->ReadAt(finfo, (uint8_t *)config.data(), 0,
+				      finfo.size);
+		if (ret < 0) {
+			std::cerr << "Error loading config file" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		config.resize(ret);
+	}
+
+	const char *unknown;
+	bool ok = RunScript(config.data(), commands, unknown);
+
+	if (!ok && unknown != nullptr)
+		std::cout << "Error, unknown command: " << unknown << std::endl;
+
+	auto end = std::chrono::steady_clock::now();
+	std::chrono::duration<double, std::milli> wall = end - start;
+
+	std::cout << "Total: ";
+	PrintCost(io.requests, io.sectors, wall.count());
+
+	// same as stage2, which boots whatever the loader has left loaded
+	if (!loader.HaveKernel() && !loader.HaveLinux()) {
+		std::cout << "No kernel loaded!" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
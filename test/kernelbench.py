@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: ISC
+#
+# kernelbench.py
+#
+# Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+#
+# Boots a disk image in Qemu and collects the results of the kernel micro
+# benchmarks from the debug console (port 0xE9).
+#
+# The kernel must be built with -Dkernel_bench=true. It then prints
+# "@tsc <kHz>" followed by "@bench <name> <batch> <samples> <min> <median>
+# <p99>" lines, with TSC ticks per operation, and exits Qemu through the
+# isa-debug-exit device. The same lines can be taken from a Bochs log with
+# port_e9_hack enabled, and passed in with --log.
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+
+def boot(args, log):
+    cmd = [args.qemu, '-m', str(args.memory), '-smp', str(args.smp),
+           '-drive', 'format=raw,file=' + args.disk,
+           '-debugcon', 'file:' + log,
+           '-device', 'isa-debug-exit,iobase=0xf4,iosize=0x04',
+           '-display', 'none', '-no-reboot']
+
+    try:
+        ret = subprocess.run(cmd, timeout=args.timeout,
+                             stdout=subprocess.DEVNULL,
+                             stderr=subprocess.PIPE).returncode
+    except subprocess.TimeoutExpired:
+        return 'timeout'
+
+    return 'ok' if ret == 1 else 'error %d' % ret
+
+
+def parse(log):
+    khz = 0
+    results = []
+
+    for line in open(log, errors='replace'):
+        fields = line.split()
+
+        if len(fields) == 2 and fields[0] == '@tsc':
+            khz = int(fields[1])
+        elif len(fields) == 7 and fields[0] == '@bench':
+            names = ('batch', 'samples', 'min', 'median', 'p99')
+            entry = {'name': fields[1]}
+            entry.update(zip(names, map(int, fields[2:])))
+            results.append(entry)
+
+    for entry in results:
+        for key in ('min', 'median', 'p99'):
+            ns = entry[key] * 1000000.0 / khz if khz > 0 else 0.0
+            entry[key + '_ns'] = round(ns, 2)
+
+    return khz, results
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Kernel micro benchmarks")
+    parser.add_argument('--disk', help='disk image to boot in Qemu')
+    parser.add_argument('--log', help='parse an existing debug port log')
+    parser.add_argument('--qemu', default='qemu-system-i386')
+    parser.add_argument('--memory', type=int, default=128)
+    parser.add_argument('--smp', type=int, default=1)
+    parser.add_argument('--timeout', type=int, default=120)
+    parser.add_argument('--output', default='kernelbench.json')
+    parser.add_argument('--baseline',
+                        help='fail if a median is slower than in this report')
+    parser.add_argument('--tolerance', type=float, default=10.0,
+                        help='allowed slowdown against the baseline in %%')
+    args = parser.parse_args()
+
+    if args.log is None and args.disk is None:
+        sys.exit('either --disk or --log is required')
+
+    status = 'ok'
+
+    if args.log is None:
+        fd, log = tempfile.mkstemp(prefix='hausboot-kbench-')
+        os.close(fd)
+        try:
+            status = boot(args, log)
+            khz, results = parse(log)
+        finally:
+            os.unlink(log)
+    else:
+        khz, results = parse(args.log)
+
+    for r in results:
+        print('%-24s min %10.2f ns  median %10.2f ns  p99 %10.2f ns' %
+              (r['name'], r['min_ns'], r['median_ns'], r['p99_ns']))
+
+    with open(args.output, 'w') as f:
+        json.dump({'status': status, 'tsc_khz': khz,
+                   'benchmarks': results}, f, indent=2)
+
+    if not results:
+        print('no results seen, is the kernel built with kernel_bench?')
+        return 1
+
+    failed = status != 'ok'
+
+    if args.baseline:
+        base = {}
+        for r in json.load(open(args.baseline))['benchmarks']:
+            base[r['name']] = r['median_ns']
+
+        for r in results:
+            old = base.get(r['name'], 0)
+            if old <= 0:
+                continue
+            change = (r['median_ns'] - old) * 100.0 / old
+            if change > args.tolerance:
+                print('regression: %s: %+.2f%%' % (r['name'], change))
+                failed = True
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
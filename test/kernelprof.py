@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: ISC
+#
+# kernelprof.py
+#
+# Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+#
+# Turns the sample histogram of the kernel profiler into a list of the
+# hottest functions, using the link map of the kernel.
+#
+# The kernel must be built with -Dkernel_profile=true. It then dumps
+# "@profile", "@cpu" and "@pc <address> <samples>" lines to the debug
+# console (port 0xE9) and the serial port before it halts, and exits Qemu
+# through the isa-debug-exit device. The kernel is compiled with one section
+# per function in that case, so the link map names every function, even
+# static ones.
+import argparse
+import bisect
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+SECTION_RE = re.compile(r'^ \.text\.(\S+)(?:\s+0x([0-9a-f]+)\s+0x[0-9a-f]+\s)?')
+ADDR_RE = re.compile(r'^\s+0x([0-9a-f]+)\s+0x[0-9a-f]+\s+\S+')
+SYMBOL_RE = re.compile(r'^\s+0x([0-9a-f]+)\s+([^=\s].*)$')
+
+
+def demangle(names):
+    if not names or shutil.which('c++filt') is None:
+        return names
+    ret = subprocess.run(['c++filt'], input='\n'.join(names), text=True,
+                         stdout=subprocess.PIPE, check=True).stdout
+    return ret.splitlines()
+
+
+def load_map(path):
+    symbols = {}
+    pending = None
+
+    for line in open(path, errors='replace'):
+        line = line.rstrip('\n')
+        match = SECTION_RE.match(line)
+        if match:
+            if match.group(2):
+                symbols.setdefault(int(match.group(2), 16), match.group(1))
+                pending = None
+            else:
+                pending = match.group(1)
+            continue
+
+        match = ADDR_RE.match(line)
+        if match and pending is not None:
+            symbols.setdefault(int(match.group(1), 16), pending)
+            pending = None
+            continue
+
+        pending = None
+        match = SYMBOL_RE.match(line)
+        if match and not match.group(2).startswith('__'):
+            # global symbols are already demangled by the linker
+            symbols[int(match.group(1), 16)] = '=' + match.group(2).strip()
+
+    addrs = sorted(symbols)
+    mangled = [symbols[a] for a in addrs if not symbols[a].startswith('=')]
+    plain = iter(demangle(mangled))
+    names = [symbols[a][1:] if symbols[a].startswith('=') else next(plain)
+             for a in addrs]
+    return addrs, names
+
+
+def boot(args, log):
+    cmd = [args.qemu, '-m', str(args.memory), '-smp', str(args.smp),
+           '-drive', 'format=raw,file=' + args.disk,
+           '-debugcon', 'file:' + log,
+           '-device', 'isa-debug-exit,iobase=0xf4,iosize=0x04',
+           '-display', 'none', '-no-reboot']
+    try:
+        subprocess.run(cmd, timeout=args.timeout, stdout=subprocess.DEVNULL,
+                       stderr=subprocess.PIPE)
+    except subprocess.TimeoutExpired:
+        print('Qemu timed out, the profile may be missing')
+
+
+def parse(log):
+    cpus = {}
+    samples = {}
+    cpu = None
+
+    for line in open(log, errors='replace'):
+        fields = line.split()
+        if len(fields) == 4 and fields[0] == '@cpu':
+            cpu = int(fields[1])
+            cpus[cpu] = (int(fields[2]), int(fields[3]))
+        elif len(fields) == 3 and fields[0] == '@pc' and cpu is not None:
+            key = (cpu, int(fields[1], 16))
+            samples[key] = samples.get(key, 0) + int(fields[2])
+
+    return cpus, samples
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Kernel sampling profile")
+    parser.add_argument('--map', required=True, help='kernel link map')
+    parser.add_argument('--disk', help='disk image to boot in Qemu')
+    parser.add_argument('--log', help='parse an existing debug port log')
+    parser.add_argument('--qemu', default='qemu-system-i386')
+    parser.add_argument('--memory', type=int, default=128)
+    parser.add_argument('--smp', type=int, default=4)
+    parser.add_argument('--timeout', type=int, default=120)
+    parser.add_argument('--top', type=int, default=25)
+    args = parser.parse_args()
+
+    if args.log is None and args.disk is None:
+        sys.exit('either --disk or --log is required')
+
+    addrs, names = load_map(args.map)
+
+    if args.log is None:
+        fd, log = tempfile.mkstemp(prefix='hausboot-kprof-')
+        os.close(fd)
+        try:
+            boot(args, log)
+            cpus, samples = parse(log)
+        finally:
+            os.unlink(log)
+    else:
+        cpus, samples = parse(args.log)
+
+    if not cpus:
+        print('no profile seen, is the kernel built with kernel_profile?')
+        return 1
+
+    total = sum(t for t, _ in cpus.values())
+    for cpu in sorted(cpus):
+        print('CPU %d: %d samples, %d outside the kernel' %
+              ((cpu,) + cpus[cpu]))
+
+    funcs = {}
+    for (cpu, pc), count in samples.items():
+        i = bisect.bisect_right(addrs, pc) - 1
+        name = names[i] if i >= 0 else '0x%08x' % pc
+        funcs[name] = funcs.get(name, 0) + count
+
+    print()
+    for name, count in sorted(funcs.items(), key=lambda x: -x[1])[:args.top]:
+        print('%8d %6.2f%%  %s' % (count, count * 100.0 / max(total, 1),
+                                   name))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,410 @@
+/* SPDX-License-Identifier: ISC */
+/*
+ * microbench.cpp
+ *
+ * Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+ */
+#include "types/UnalignedInt.h"
+#include "fs/FatSuper.h"
+#include "fs/FatFs.h"
+#include "host/File.h"
+#include "Stage2Header.h"
+#include "Memory.h"
+
+#include <sys/stat.h>
+
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+
+/*
+  Microbenchmarks for the library code the boot loader is built from, so
+  that optimizations can be measured without booting anything.
+
+  The FAT benchmarks run on top of a RAM copy of a FAT32 image, with an
+  optional busy-waiting delay per block device request. For each test,
+  the time and the number of requests and sectors per operation are
+  reported.
+*/
+
+// stage2/heap.cpp, renamed at build time to not clash with the C library
+extern "C" {
+	void *HeapMalloc(size_t count);
+	void HeapFree(void *ptr);
+}
+
+static struct {
+	uint32_t partStart = 0;
+	uint32_t latency = 0;
+	uint32_t iterations = 1000;
+	uint32_t readSize = 4096;
+	const char *fileName = "BOOT/KRNL386.SYS";
+	const char *image = nullptr;
+} options;
+
+static struct {
+	uint64_t requests = 0;
+	uint64_t sectors = 0;
+} io;
+
+static volatile uint64_t sink;
+
+/*****************************************************************************/
+
+class RamBlockDevice : public IBlockDevice {
+public:
+	RamBlockDevice(const uint8_t *data, size_t size, uint32_t latency) :
+		_data(data), _sectorCount(size / 512), _latency(latency) {
+	}
+
+	virtual bool LoadSector(uint32_t index, void *buffer) override final {
+		return Transfer(index, buffer, 1);
+	}
+
+	virtual bool Submit(BlockRequest &req) override final {
+		req.success = Transfer(req.index, req.buffer, req.count);
+
+		if (req.completion != nullptr)
+			req.completion(req);
+		return true;
+	}
+
+	virtual uint16_t SectorSize() const override final {
+		return 512;
+	}
+private:
+	bool Transfer(uint32_t index, void *buffer, uint32_t count) {
+		if (index >= _sectorCount || count > (_sectorCount - index))
+			return false;
+
+		io.requests += 1;
+		io.sectors += count;
+
+		if (_latency > 0) {
+			auto end = std::chrono::steady_clock::now() +
+				std::chrono::nanoseconds(_latency);
+
+			while (std::chrono::steady_clock::now() < end)
+				;
+		}
+
+		memcpy(buffer, _data + (size_t)index * 512, (size_t)count * 512);
+		return true;
+	}
+
+	const uint8_t *_data;
+	size_t _sectorCount;
+	uint32_t _latency;
+};
+
+/*****************************************************************************/
+
+static uint32_t Random(uint32_t &state)
+{
+	// xorshift32, fixed seeds keep the runs comparable
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+template<typename F>
+static bool Run(const char *name, uint64_t count, F fn)
+{
+	auto requests = io.requests;
+	auto sectors = io.sectors;
+	auto start = std::chrono::steady_clock::now();
+
+	for (uint64_t i = 0; i < count; ++i) {
+		if (!fn(i)) {
+			std::cerr << name << ": failed in iteration " << i
+				  << std::endl;
+			return false;
+		}
+	}
+
+	auto end = std::chrono::steady_clock::now();
+	std::chrono::duration<double, std::nano> ns = end - start;
+
+	std::cout << std::left << std::setw(24) << name << std::right
+		  << std::fixed << std::setprecision(1)
+		  << std::setw(12) << (ns.count() / count) << " ns/op"
+		  << std::setprecision(2)
+		  << std::setw(10) << ((double)(io.requests - requests) / count)
+		  << " req/op"
+		  << std::setw(10) << ((double)(io.sectors - sectors) / count)
+		  << " sec/op" << std::endl;
+	return true;
+}
+
+/*****************************************************************************/
+
+static bool BenchFatFs(const std::vector<uint8_t> &image)
+{
+	auto *base = image.data() + (size_t)options.partStart * 512;
+	auto size = image.size() - (size_t)options.partStart * 512;
+	FatSuper super;
+
+	memcpy(&super, base, sizeof(super));
+
+	if (super.BytesPerSector() != 512) {
+		std::cerr << "Only 512 byte sectors are supported" << std::endl;
+		return false;
+	}
+
+	auto MakeFs = [&]() {
+		auto blk = UniquePtr<IBlockDevice>(
+			new RamBlockDevice(base, size, options.latency));
+
+		return MakeUnique<FatFs>(std::move(blk), super);
+	};
+
+	auto fs = MakeFs();
+	FatFile finfo;
+
+	if (fs->FindByPath(options.fileName, finfo) != FatFs::FindResult::Ok) {
+		std::cerr << options.fileName << ": not found" << std::endl;
+		return false;
+	}
+
+	if (finfo.size == 0) {
+		std::cerr << options.fileName << ": empty file" << std::endl;
+		return false;
+	}
+
+	std::cout << options.fileName << ": " << finfo.size << " bytes, "
+		  << fs->BytesPerCluster() << " bytes per cluster"
+		  << std::endl << std::endl;
+
+	auto iterations = options.iterations;
+	auto readSize = options.readSize;
+	std::vector<uint8_t> buffer(finfo.size);
+	uint32_t seed = 0x12345678;
+	bool ok;
+
+	ok = Run("lookup (cold)", iterations, [&](uint64_t) {
+		auto cold = MakeFs();
+		FatFile out;
+
+		return cold->FindByPath(options.fileName, out) ==
+			FatFs::FindResult::Ok;
+	});
+
+	ok = ok && Run("lookup (warm)", iterations, [&](uint64_t) {
+		FatFile out;
+
+		return fs->FindByPath(options.fileName, out) ==
+			FatFs::FindResult::Ok;
+	});
+
+	uint32_t chunks = (finfo.size + readSize - 1) / readSize;
+
+	ok = ok && Run("ReadAt sequential", (uint64_t)chunks * 4, [&](uint64_t i) {
+		uint32_t offset = (i % chunks) * readSize;
+
+		return fs->ReadAt(finfo, buffer.data(), offset, readSize) > 0;
+	});
+
+	ok = ok && Run("ReadAt random", iterations, [&](uint64_t) {
+		uint32_t offset = Random(seed) % finfo.size;
+
+		return fs->ReadAt(finfo, buffer.data(), offset, readSize) > 0;
+	});
+
+	ok = ok && Run("ReadAt whole file", iterations / 10 + 1, [&](uint64_t) {
+		return fs->ReadAt(finfo, buffer.data(), 0, finfo.size) ==
+			(int32_t)finfo.size;
+	});
+
+	return ok;
+}
+
+static bool BenchChecksums()
+{
+	auto iterations = (uint64_t)options.iterations * 100;
+	std::vector<uint32_t> stage2(Stage2MaxSize / 4);
+
+	for (size_t i = 0; i < stage2.size(); ++i)
+		stage2[i] = i * 0x9E3779B9;
+
+	auto *hdr = (Stage2Header *)stage2.data();
+	hdr->SetSectorCount(Stage2MaxSize);
+
+	bool ok = Run("Stage2Header checksum", iterations / 10, [&](uint64_t) {
+		sink = hdr->ComputeChecksum();
+		return true;
+	});
+
+	static const char *names[] = {
+		"KRNL386", "BOOT", "INITRD", "A", "LONGNAME", "X", "Y", "Z",
+	};
+	FatDirent dirents[8];
+
+	for (size_t i = 0; i < 8; ++i) {
+		dirents[i].SetName(names[i]);
+		dirents[i].SetExtension(i % 2 ? "SYS" : "");
+	}
+
+	ok = ok && Run("FatDirent checksum", iterations, [&](uint64_t i) {
+		sink = dirents[i % 8].Checksum();
+		return true;
+	});
+
+	static const char *paths[] = {
+		"KRNL386.SYS", "BOOT.CFG", "BOOT", "INITRD.IMG",
+		"toolongname.txt", "A.B.C", "SPACE .X", "NOEXT.",
+	};
+
+	ok = ok && Run("IsShortName", iterations, [&](uint64_t i) {
+		sink = IsShortName(paths[i % 8]);
+		return true;
+	});
+
+	std::vector<uint8_t> raw(4096 + 3);
+	for (size_t i = 0; i < raw.size(); ++i)
+		raw[i] = i;
+
+	ok = ok && Run("UnalignedInt<uint32_t>", iterations, [&](uint64_t i) {
+		auto *ptr = (const UnalignedInt<uint32_t> *)(raw.data() + 1);
+
+		sink = ptr[i % 1024].Read();
+		return true;
+	});
+
+	return ok;
+}
+
+static bool BenchHeap(size_t live)
+{
+	// same size as the stage2 heap
+	std::vector<uint8_t> arena(0x70000);
+	std::vector<void *> slots(live, nullptr);
+	uint32_t seed = 0xCAFEBABE;
+
+	HeapInit(arena.data(), arena.size());
+
+	char name[32];
+	snprintf(name, sizeof(name), "heap churn (%zu live)", live);
+
+	bool ok = Run(name, options.iterations * 10, [&](uint64_t) {
+		auto &slot = slots[Random(seed) % live];
+
+		if (slot != nullptr) {
+			HeapFree(slot);
+			slot = nullptr;
+			return true;
+		}
+
+		slot = HeapMalloc(16 + Random(seed) % 2048);
+		return slot != nullptr;
+	});
+
+	for (auto *ptr : slots)
+		HeapFree(ptr);
+
+	return ok;
+}
+
+/*****************************************************************************/
+
+static void Usage()
+{
+	std::cout << "Usage: microbench [OPTIONS...] <FAT32 image>"
+		  << std::endl << std::endl
+		  << "Measures the FAT, heap and checksum code of the boot loader."
+		  << std::endl << std::endl
+		  << "  --offset <sector>       partition start in the image"
+		  << std::endl
+		  << "  --latency <ns>          simulated cost of a disk request"
+		  << std::endl
+		  << "  --iterations <count>    base iteration count (1000)"
+		  << std::endl
+		  << "  --read-size <bytes>     ReadAt size (4096)"
+		  << std::endl
+		  << "  --file <path>           file to look up and read"
+		  << std::endl
+		  << "                          (BOOT/KRNL386.SYS)"
+		  << std::endl;
+}
+
+static bool ParseOptions(int argc, char **argv)
+{
+	for (int i = 1; i < argc; ++i) {
+		if (argv[i][0] != '-') {
+			if (options.image != nullptr)
+				return false;
+			options.image = argv[i];
+			continue;
+		}
+
+		if ((i + 1) >= argc) {
+			std::cerr << "Missing argument for `" << argv[i]
+				  << "`" << std::endl;
+			return false;
+		}
+
+		const char *arg = argv[++i];
+		auto value = strtoul(arg, nullptr, 0);
+
+		if (!strcmp(argv[i - 1], "--offset")) {
+			options.partStart = value;
+		} else if (!strcmp(argv[i - 1], "--latency")) {
+			options.latency = value;
+		} else if (!strcmp(argv[i - 1], "--iterations")) {
+			options.iterations = value;
+		} else if (!strcmp(argv[i - 1], "--read-size")) {
+			options.readSize = value;
+		} else if (!strcmp(argv[i - 1], "--file")) {
+			options.fileName = arg;
+		} else {
+			std::cerr << "Unknown option `" << argv[i - 1] << "`"
+				  << std::endl;
+			return false;
+		}
+	}
+
+	return options.image != nullptr && options.iterations > 0 &&
+		options.readSize > 0;
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<uint8_t> image;
+	struct stat sb;
+
+	if (!ParseOptions(argc, argv)) {
+		Usage();
+		return EXIT_FAILURE;
+	}
+
+	if (stat(options.image, &sb) != 0) {
+		perror(options.image);
+		return EXIT_FAILURE;
+	}
+
+	if ((uint64_t)sb.st_size < ((uint64_t)options.partStart + 1) * 512) {
+		std::cerr << options.image << ": too small" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	try {
+		File file(options.image, true);
+
+		image.resize(sb.st_size);
+		file.ReadAt(0, image.data(), image.size());
+	} catch (std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (!BenchFatFs(image) || !BenchChecksums())
+		return EXIT_FAILURE;
+
+	if (!BenchHeap(8) || !BenchHeap(128))
+		return EXIT_FAILURE;
+
+	return EXIT_SUCCESS;
+}
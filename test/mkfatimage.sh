@@ -7,11 +7,13 @@ CFGFILE="$4"
 FATEDIT="$5"
 INSTALLFAT="$6"
 IMGFILE="$7"
+STUBFILE="$8"
 
 dd if=/dev/zero of="$IMGFILE" bs=1M count=40
 mkfs.fat -F 32 "$IMGFILE"
 
-"$INSTALLFAT" -v "$VBRFILE" -o "$IMGFILE" --stage2 "$STAGE2FILE"
+"$INSTALLFAT" -v "$VBRFILE" -o "$IMGFILE" --stage2 "$STAGE2FILE" \
+	      --stub "$STUBFILE"
 
 echo "mkdir BOOT" | "$FATEDIT" "$IMGFILE"
 echo "pack $KERNELFILE BOOT/KRNL386.SYS" | "$FATEDIT" "$IMGFILE"
@@ -0,0 +1,280 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: ISC
+#
+# qemubench.py
+#
+# Copyright (C) 2023 David Oberhollenzer <goliath@infraroot.at>
+#
+# Boots disk images in Qemu with deterministic instruction counting and
+# reports how long each stage2 boot phase took, for a matrix of cluster
+# sizes, fragmentation levels and kernel sizes.
+#
+# stage2 must be built with -Dbench_markers=true. It then prints
+# "@<phase> <TSC>" lines to the debug console (port 0xE9) and exits Qemu
+# through the isa-debug-exit device. With -icount shift=0, the TSC counts
+# virtual nanoseconds, i.e. one tick per guest instruction.
+import argparse
+import json
+import os
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+
+MIB = 1024 * 1024
+PART_START = 2048
+
+# Qemu guesses the BIOS disk geometry from the end of the partition in the
+# MBR. With no more than 16 heads, it takes the guess as is, so the CHS
+# addresses written below are the ones INT 13h works with.
+HEADS = 16
+SECTORS = 63
+
+
+def run(cmd, stdin=None):
+    subprocess.run(cmd, input=stdin, check=True, text=True,
+                   stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+
+
+def chs(lba):
+    cylinder = lba // (HEADS * SECTORS)
+    if cylinder > 1023:
+        cylinder, head, sector = 1023, HEADS - 1, SECTORS
+    else:
+        head = (lba // SECTORS) % HEADS
+        sector = lba % SECTORS + 1
+    return bytes([head, sector | ((cylinder >> 2) & 0xC0), cylinder & 0xFF])
+
+
+def pad_kernel(src, dst, size):
+    # Grow the multiboot load range, so the loader has to read `size` bytes
+    data = bytearray(open(src, 'rb').read())
+    magic = struct.pack('<I', 0x1BADB002)
+    offset = data.find(magic)
+    if offset < 0 or offset > 8192 - 32:
+        raise RuntimeError(src + ': no multiboot header found')
+
+    hdr_addr, load_addr, load_end, bss_end = \
+        struct.unpack_from('<IIII', data, offset + 12)
+    file_start = offset - (hdr_addr - load_addr)
+
+    if size > len(data):
+        # zero padding, so the original BSS is still cleared
+        data += bytes(size - len(data))
+        load_end = load_addr + len(data) - file_start
+        bss_end = max(bss_end, load_end)
+        struct.pack_into('<II', data, offset + 20, load_end, bss_end)
+
+    open(dst, 'wb').write(data)
+
+
+def make_disk(args, workdir, spc, stride, kernel_size):
+    kernel = os.path.join(workdir, 'KRNL386.SYS')
+    config = os.path.join(workdir, 'BOOT.CFG')
+    fatpart = os.path.join(workdir, 'fatpart.img')
+    disk = os.path.join(workdir, 'disk.img')
+
+    pad_kernel(args.kernel, kernel, kernel_size)
+
+    with open(config, 'w') as f:
+        f.write('multiboot BOOT/KRNL386.SYS\n')
+
+    # FAT32 needs at least 65525 clusters, leave room for the kernel
+    need = 66000 * spc * 512 + 2 * kernel_size + 4 * MIB
+    size = max(40 * MIB, (need + MIB - 1) // MIB * MIB)
+
+    # the geometry guess assumes the partition ends on a cylinder boundary
+    cylinder = HEADS * SECTORS
+    end = (PART_START + size // 512 + cylinder - 1) // cylinder * cylinder
+    size = (end - PART_START) * 512
+
+    for path in (fatpart, disk):
+        if os.path.exists(path):
+            os.unlink(path)
+
+    with open(fatpart, 'wb') as f:
+        f.truncate(size)
+
+    run(['mkfs.fat', '-F', '32', '-s', str(spc), fatpart])
+
+    run([args.installfat, '-v', args.vbr, '-o', fatpart,
+         '--stage2', args.stage2, '--stub', args.stub])
+
+    script = ''
+    if stride > 0:
+        script += 'fragment %d\n' % stride
+    script += 'mkdir BOOT\n'
+    script += 'pack %s BOOT/KRNL386.SYS\n' % kernel
+    script += 'pack %s BOOT.CFG\n' % config
+    run([args.fatedit, fatpart], stdin=script)
+
+    # MBR with a single, bootable FAT32 (LBA) partition
+    end = PART_START + size // 512 - 1
+    mbr = bytearray(open(args.mbr, 'rb').read()[:446].ljust(512, b'\0'))
+    struct.pack_into('<B3sB3sII', mbr, 446, 0x80, chs(PART_START), 0x0C,
+                     chs(end), PART_START, size // 512)
+    mbr[510:512] = b'\x55\xAA'
+
+    # copy the partition sparsely, the images can get big
+    with open(disk, 'wb') as out, open(fatpart, 'rb') as inp:
+        out.truncate(PART_START * 512 + size)
+        out.write(mbr)
+        offset = 0
+        while True:
+            block = inp.read(MIB)
+            if not block:
+                break
+            if block.count(0) != len(block):
+                out.seek(PART_START * 512 + offset)
+                out.write(block)
+            offset += len(block)
+
+    os.unlink(fatpart)
+    return disk
+
+
+def boot(args, workdir, disk):
+    log = os.path.join(workdir, 'debugcon.log')
+    if os.path.exists(log):
+        os.unlink(log)
+
+    cmd = [args.qemu, '-m', str(args.memory),
+           '-drive', 'format=raw,file=' + disk,
+           '-icount', 'shift=0,align=off,sleep=off',
+           '-debugcon', 'file:' + log,
+           '-device', 'isa-debug-exit,iobase=0xf4,iosize=0x04',
+           '-display', 'none', '-no-reboot']
+
+    try:
+        ret = subprocess.run(cmd, timeout=args.timeout,
+                             stdout=subprocess.DEVNULL,
+                             stderr=subprocess.PIPE).returncode
+    except subprocess.TimeoutExpired:
+        ret = None
+
+    phases = []
+    last = None
+
+    if os.path.exists(log):
+        for line in open(log, errors='replace'):
+            if not line.startswith('@'):
+                continue
+            fields = line[1:].split()
+            if len(fields) != 2:
+                continue
+            ticks = int(fields[1], 16)
+            phases.append({
+                'name': fields[0],
+                'ticks': ticks,
+                'delta': ticks - last if last is not None else ticks,
+            })
+            last = ticks
+
+    if ret is None:
+        status = 'timeout'
+    elif ret == 1:
+        status = 'ok'
+    elif ret == 3:
+        status = 'failed'
+    else:
+        status = 'error %d' % ret
+
+    return status, phases
+
+
+def int_list(text):
+    return [int(x, 0) for x in text.split(',') if x]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Qemu boot benchmark")
+    parser.add_argument('--mbr', required=True)
+    parser.add_argument('--vbr', required=True)
+    parser.add_argument('--stage2', required=True)
+    parser.add_argument('--stub', required=True)
+    parser.add_argument('--kernel', required=True)
+    parser.add_argument('--fatedit', required=True)
+    parser.add_argument('--installfat', required=True)
+    parser.add_argument('--qemu', default='qemu-system-i386')
+    parser.add_argument('--memory', type=int, default=128)
+    parser.add_argument('--timeout', type=int, default=120)
+    parser.add_argument('--cluster-sizes', type=int_list, default='1,8,64',
+                        help='sectors per cluster')
+    parser.add_argument('--fragmentation', type=int_list, default='0,16,2',
+                        help='every Nth free cluster is marked bad, 0 = none')
+    parser.add_argument('--kernel-sizes', type=int_list,
+                        default='65536,1048576,4194304')
+    parser.add_argument('--output', default='bench.json')
+    parser.add_argument('--baseline',
+                        help='fail if a run is slower than in this report')
+    parser.add_argument('--tolerance', type=float, default=2.0,
+                        help='allowed slowdown against the baseline in %%')
+    args = parser.parse_args()
+
+    for tool in (args.qemu, 'mkfs.fat'):
+        if shutil.which(tool) is None:
+            sys.exit(tool + ': not found')
+
+    runs = []
+    workdir = tempfile.mkdtemp(prefix='hausboot-bench-')
+
+    try:
+        for spc in args.cluster_sizes:
+            for stride in args.fragmentation:
+                for size in args.kernel_sizes:
+                    disk = make_disk(args, workdir, spc, stride, size)
+                    status, phases = boot(args, workdir, disk)
+                    os.unlink(disk)
+
+                    run_info = {
+                        'sectors_per_cluster': spc,
+                        'fragment_stride': stride,
+                        'kernel_size': size,
+                        'status': status,
+                        'phases': phases,
+                        'total_ticks': phases[-1]['ticks'] if phases else 0,
+                    }
+                    runs.append(run_info)
+                    print('spc=%d frag=%d kernel=%d: %s, %d ticks' %
+                          (spc, stride, size, status,
+                           run_info['total_ticks']))
+    finally:
+        shutil.rmtree(workdir)
+
+    report = {
+        'icount_shift': 0,
+        'unit': 'instructions',
+        'runs': runs,
+    }
+
+    with open(args.output, 'w') as f:
+        json.dump(report, f, indent=2)
+
+    failed = [r for r in runs if r['status'] != 'ok']
+    if any(not r['phases'] for r in runs):
+        print('no phase markers seen, is stage2 built with bench_markers?')
+
+    if args.baseline:
+        base = {}
+        for r in json.load(open(args.baseline))['runs']:
+            key = (r['sectors_per_cluster'], r['fragment_stride'],
+                   r['kernel_size'])
+            base[key] = r['total_ticks']
+
+        for r in runs:
+            key = (r['sectors_per_cluster'], r['fragment_stride'],
+                   r['kernel_size'])
+            if key not in base or base[key] == 0:
+                continue
+            change = (r['total_ticks'] - base[key]) * 100.0 / base[key]
+            if change > args.tolerance:
+                print('regression: spc=%d frag=%d kernel=%d: %+.2f%%' %
+                      (key + (change,)))
+                failed.append(r)
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
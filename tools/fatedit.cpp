@@ -18,6 +18,8 @@
 #include <vector>
 #include <cctype>
 #include <string>
+#include <map>
+#include <set>
 
 struct DirEntry {
 	std::string shortName;
@@ -66,6 +68,8 @@ public:
 		_fatRaw.resize(size);
 
 		file.ReadAt(offset, _fatRaw.data(), _fatRaw.size());
+
+		BuildFreeIndex();
 	}
 
 	void WriteToImage() {
@@ -88,16 +92,64 @@ public:
 		auto out = FindFreeCluster();
 		if (out >= 0x0FFFFFF8)
 			throw std::runtime_error("No free cluster available");
-		Set(out, 0x0FFFFFF8);
+		Take(out, 0x0FFFFFF8);
 		return out;
 	}
 
 	uint32_t AllocateCluster(uint32_t lastInFile) {
-		auto out = AllocateCluster();
+		// continue the file right behind its last cluster, if possible
+		auto out = lastInFile + 1;
+
+		if (!IsFree(out)) {
+			out = FindFreeCluster();
+			if (out >= 0x0FFFFFF8)
+				throw std::runtime_error("No free cluster available");
+		}
+
+		Take(out, 0x0FFFFFF8);
 		Set(lastInFile, out);
 		return out;
 	}
 
+	/*
+	  First cluster of a new file, that is expected to need the given
+	  number of clusters. If possible, the file is placed in the smallest
+	  free extent that can hold it entirely, so the following calls to
+	  AllocateCluster(lastInFile) keep it contiguous.
+
+	  Not after Fragment, which is there to get fragmented files.
+	*/
+	uint32_t AllocateFileStart(uint32_t count) {
+		auto it = _extentsBySize.lower_bound({ count, 0 });
+
+		if (_fragmented || count <= 1 || it == _extentsBySize.end())
+			return AllocateCluster();
+
+		auto out = it->second;
+
+		Take(out, 0x0FFFFFF8);
+		return out;
+	}
+
+	// Mark every Nth free cluster as bad, so later files get fragmented
+	uint32_t Fragment(uint32_t stride) {
+		uint32_t count = 0, free = 0;
+
+		_fragmented = true;
+
+		for (uint32_t i = 2; i < _clusterEnd; ++i) {
+			if (!IsFree(i))
+				continue;
+
+			if ((++free % stride) == 0) {
+				Take(i, 0x0FFFFFF7);
+				++count;
+			}
+		}
+
+		return count;
+	}
+
 	uint64_t ClusterFileOffset(uint32_t index) const {
 		return super.ClusterIndex2Sector(index) *
 			super.BytesPerSector();
@@ -120,42 +172,114 @@ private:
 	}
 
 	uint32_t NumFreeClusters() const {
-		uint32_t count = 0;
+		return _numFree;
+	}
 
-		for (size_t i = 0; i < (_fatRaw.size() / 4); ++i) {
-			if (NextClusterInFile(i) == 0)
-				++count;
-		}
+	bool IsFree(uint32_t N) const {
+		if (N < 2 || N >= _clusterEnd)
+			return false;
 
-		return count;
+		return (_freeMap[N / 64] >> (N % 64)) & 1;
 	}
 
+	// Nothing below the cursor is free, nothing is ever freed either
 	uint32_t FindFreeCluster() {
+		for (auto i = _nextFree / 64; i < _freeMap.size(); ++i) {
+			if (_freeMap[i] != 0) {
+				_nextFree = i * 64 + __builtin_ctzll(_freeMap[i]);
+				return _nextFree;
+			}
+		}
+
+		_nextFree = _clusterEnd;
+		return 0x0FFFFFF8;
+	}
+
+	/*
+	  Free space index: a bitmap of the free clusters, and the runs of
+	  free clusters, by start and by size. The FAT may have more entries
+	  than there are clusters on the disk, the excess is never free.
+	*/
+	void BuildFreeIndex() {
 		auto fatSectors = super.SectorsPerFat() * super.NumFats();
-		auto total = super.SectorCount();
+		uint32_t total = super.SectorCount();
 
-		if (total <= fatSectors)
-			return 0x0FFFFFFF8;
-		total -= fatSectors;
+		if (total > fatSectors + super.ReservedSectors() &&
+		    super.SectorsPerCluster() > 0) {
+			total -= fatSectors + super.ReservedSectors();
+			total /= super.SectorsPerCluster();
+		} else {
+			total = 0;
+		}
 
-		if (total <= super.ReservedSectors())
-			return 0x0FFFFFFF8;
-		total -= super.ReservedSectors();
+		_clusterEnd = std::min<size_t>(total + 2, _fatRaw.size() / 4);
+		_clusterEnd = std::max<uint32_t>(_clusterEnd, 2);
+		_freeMap.assign((_clusterEnd + 63) / 64, 0);
+		_extentsByStart.clear();
+		_extentsBySize.clear();
+		_nextFree = 2;
+		_numFree = 0;
+		_fragmented = false;
+
+		uint32_t start = 0, length = 0;
+
+		for (uint32_t i = 2; i < _clusterEnd; ++i) {
+			if (NextClusterInFile(i) != 0) {
+				if (length > 0)
+					AddExtent(start, length);
+				length = 0;
+				continue;
+			}
 
-		total /= super.SectorsPerCluster();
-		if (total < 1)
-			return 0x0FFFFFFF8;
+			_freeMap[i / 64] |= 1ULL << (i % 64);
+			_numFree += 1;
 
-		for (size_t i = 0; i < total; ++i) {
-			if (NextClusterInFile(i) == 0)
-				return i;
+			if (length++ == 0)
+				start = i;
 		}
 
-		return 0x0FFFFFFF8;
+		if (length > 0)
+			AddExtent(start, length);
+	}
+
+	void AddExtent(uint32_t start, uint32_t length) {
+		_extentsByStart[start] = length;
+		_extentsBySize.insert({ length, start });
+	}
+
+	// Remove a free cluster from the index and set its FAT entry
+	void Take(uint32_t N, uint32_t value) {
+		if (!IsFree(N))
+			throw std::runtime_error("Allocating a cluster twice");
+
+		_freeMap[N / 64] &= ~(1ULL << (N % 64));
+		_numFree -= 1;
+
+		auto it = std::prev(_extentsByStart.upper_bound(N));
+		auto start = it->first, length = it->second;
+
+		_extentsBySize.erase({ length, start });
+		_extentsByStart.erase(it);
+
+		if (N > start)
+			AddExtent(start, N - start);
+
+		if (N + 1 < start + length)
+			AddExtent(N + 1, start + length - (N + 1));
+
+		Set(N, value);
 	}
 
 	std::vector<uint8_t> _fatRaw;
 	FatFsInfo _fsinfo;
+
+	std::vector<uint64_t> _freeMap;
+	std::map<uint32_t, uint32_t> _extentsByStart;
+	std::set<std::pair<uint32_t, uint32_t>> _extentsBySize;
+	uint32_t _clusterEnd = 2;
+	uint32_t _nextFree = 2;
+	uint32_t _numFree = 0;
+	bool _fragmented = false;
 };
 
 static FatReader fat;
@@ -237,8 +361,13 @@ private:
 
 class FileWriter {
 public:
-	FileWriter() {
-		_cluster = fat.AllocateCluster();
+	// The size hint is used to find a place where the file fits in one piece
+	FileWriter(uint64_t sizeHint = 0) {
+		auto clusterSize = fat.BytesPerCluster();
+
+		_cluster = fat.AllocateFileStart(
+			std::min<uint64_t>((sizeHint + clusterSize - 1) /
+					   clusterSize, 0xFFFFFFFF));
 		_firstCluster = _cluster;
 		_offset = 0;
 		_totalSize = 0;
@@ -738,7 +867,7 @@ static void PackDirectory(std::string args)
 
 	// pack the input file
 	File infile(input.c_str(), true);
-	FileWriter wr;
+	FileWriter wr(infile.Size());
 
 	for (;;) {
 		char buffer[512];
@@ -757,6 +886,19 @@ static void PackDirectory(std::string args)
 			     name, wr.FirstCluster(), wr.BytesWritten());
 }
 
+static void FragmentFreeSpace(std::string args)
+{
+	auto stride = strtoul(args.c_str(), nullptr, 10);
+
+	if (stride < 2) {
+		std::cerr << "fragment: stride must be at least 2" << std::endl;
+		return;
+	}
+
+	std::cout << "Marked " << fat.Fragment(stride)
+		  << " clusters as bad" << std::endl;
+}
+
 static struct {
 	const char *name;
 	void (*callback)(std::string);
@@ -765,6 +907,7 @@ static struct {
 	{ "type", DumpFile },
 	{ "mkdir", CreateDirectory },
 	{ "pack", PackDirectory },
+	{ "fragment", FragmentFreeSpace },
 };
 
 int main(int argc, char **argv)
@@ -43,10 +43,118 @@ static bool ReadAll(const char *filename, std::vector<uint8_t> &out,
 	return true;
 }
 
+/*
+  LZ4 block format compressor for the stage2 payload. A sequence is a token
+  with the literal count in the high and the match length (minus 4) in the
+  low nibble, extended by additional bytes if 15, followed by the literals,
+  a 16 bit match offset and the match length extension. The last sequence
+  only has literals.
+*/
+static constexpr size_t MinMatch = 4;
+static constexpr size_t MaxOffset = 0xFFFF;
+static constexpr size_t MaxChain = 256;
+
+static void EmitLength(std::vector<uint8_t> &out, size_t len)
+{
+	while (len >= 255) {
+		out.push_back(255);
+		len -= 255;
+	}
+
+	out.push_back(len);
+}
+
+static void EmitSequence(std::vector<uint8_t> &out, const uint8_t *literals,
+			 size_t litCount, size_t offset, size_t matchLen)
+{
+	size_t litNibble = litCount >= 15 ? 15 : litCount;
+	size_t matchNibble = 0;
+
+	if (matchLen > 0) {
+		matchNibble = matchLen - MinMatch;
+		if (matchNibble > 15)
+			matchNibble = 15;
+	}
+
+	out.push_back((litNibble << 4) | matchNibble);
+
+	if (litNibble == 15)
+		EmitLength(out, litCount - 15);
+
+	out.insert(out.end(), literals, literals + litCount);
+
+	if (matchLen > 0) {
+		out.push_back(offset & 0xFF);
+		out.push_back((offset >> 8) & 0xFF);
+
+		if (matchNibble == 15)
+			EmitLength(out, matchLen - MinMatch - 15);
+	}
+}
+
+static std::vector<uint8_t> Compress(const uint8_t *in, size_t size)
+{
+	std::vector<long> head(1 << 16, -1), prev(size, -1);
+	std::vector<uint8_t> out;
+	size_t anchor = 0, i = 0;
+
+	auto hash = [in](size_t pos) {
+		uint32_t value;
+		memcpy(&value, in + pos, sizeof(value));
+		return (value * 2654435761U) >> 16;
+	};
+
+	auto insert = [&](size_t pos) {
+		if ((pos + MinMatch) <= size) {
+			auto h = hash(pos);
+			prev[pos] = head[h];
+			head[h] = pos;
+		}
+	};
+
+	while ((i + MinMatch) <= size) {
+		size_t bestLen = 0, bestOffset = 0, depth = 0;
+
+		for (long cand = head[hash(i)]; cand >= 0 && depth < MaxChain;
+		     cand = prev[cand], ++depth) {
+			if ((i - cand) > MaxOffset)
+				break;
+
+			size_t len = 0;
+
+			while ((i + len) < size && in[cand + len] == in[i + len])
+				++len;
+
+			if (len > bestLen) {
+				bestLen = len;
+				bestOffset = i - cand;
+			}
+		}
+
+		if (bestLen < MinMatch) {
+			insert(i++);
+			continue;
+		}
+
+		EmitSequence(out, in + anchor, i - anchor,
+			     bestOffset, bestLen);
+
+		for (size_t j = 0; j < bestLen; ++j)
+			insert(i + j);
+
+		i += bestLen;
+		anchor = i;
+	}
+
+	EmitSequence(out, in + anchor, size - anchor, 0, 0);
+	return out;
+}
+
 int main(int argc, char **argv)
 {
 	const char *vbrFile = nullptr;
 	const char *stage2File = nullptr;
+	const char *stubFile = nullptr;
 	const char *outFile = nullptr;
 
 	for (int i = 1; i < argc; ++i) {
@@ -61,6 +169,17 @@ int main(int argc, char **argv)
 			continue;
 		}
 
+		if (!strcmp(argv[i], "--stub")) {
+			if ((i + 1) >= argc) {
+				std::cerr << "Missing argument for `" << argv[i]
+					  << "`" << std::endl;
+				return EXIT_FAILURE;
+			}
+
+			stubFile = argv[++i];
+			continue;
+		}
+
 		if (!strcmp(argv[i], "-v")) {
 			if (argv[i][2] != '\0') {
 				vbrFile = argv[i] + 2;
@@ -109,6 +228,12 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
+	// stage2 only fits into the reserved sectors when compressed
+	if (stubFile == nullptr) {
+		std::cerr << "no stage2 stub file specified" << std::endl;
+		return EXIT_FAILURE;
+	}
+
 	try {
 		std::vector<uint8_t> stage2;
 		std::vector<uint8_t> vbr;
@@ -134,11 +259,47 @@ int main(int argc, char **argv)
 		auto max = (super.ReservedSectors() - 2) *
 			super.BytesPerSector();
 
-		if (!ReadAll(stage2File, stage2, max))
+		// the VBR does not load more than that
+		auto limit = (Stage2MaxSize / super.BytesPerSector()) *
+			super.BytesPerSector();
+
+		if (max > limit)
+			max = limit;
+
+		std::vector<uint8_t> core;
+
+		if (!ReadAll(stage2File, core, Stage2MaxUnpackedSize))
+			return EXIT_FAILURE;
+
+		if (!ReadAll(stubFile, stage2, max))
 			return EXIT_FAILURE;
 
-		auto *hdr = new (stage2.data()) Stage2Header();
-		hdr->SetSectorCount(stage2.size());
+		// the stub keeps its own header, only the rest is packed
+		auto unpacked = core.size() - sizeof(Stage2Header);
+		auto payload = Compress(core.data() + sizeof(Stage2Header),
+					unpacked);
+
+		stage2.insert(stage2.end(), payload.begin(), payload.end());
+
+		if (stage2.size() > (size_t)max) {
+			std::cerr << stage2File << " is too big (max: "
+				  << max << " compressed)" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		auto *hdr = (Stage2Header *)stage2.data();
+		new (hdr) Stage2Header();
+		hdr->SetPayloadSize(payload.size(), unpacked);
+
+		// checksum is computed over entire sectors
+		auto padding = stage2.size() % super.BytesPerSector();
+		if (padding > 0) {
+			stage2.resize(stage2.size() + super.BytesPerSector() -
+				      padding);
+		}
+
+		hdr = (Stage2Header *)stage2.data();
+		hdr->SetSectorCount(stage2.size(), super.BytesPerSector());
 		hdr->UpdateChecksum();
 
 		if (!hdr->Verify(hdr->SectorCount())) {
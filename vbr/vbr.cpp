@@ -15,42 +15,42 @@ static const char *msgErrBroken = "Stage 2 corrupted!";
 
 extern "C" {
 	void *main(BiosDisk disk, const MBREntry *ent);
+
+	bool LoadStage2(BiosDisk disk, const MBREntry *ent, uint32_t count);
 }
 
 void *main(BiosDisk disk, const MBREntry *ent)
 {
 	auto *super = (FatSuper *)0x7c00;
-	MBREntry part = *ent;
-
-	// Get and sanitze number of reserved sectors
-	auto count = super->ReservedSectors();
-	if (count < 3)
-		DumpMessageAndHang(msgErrLoad);
-
-	count -= 2;
+	auto *hdr = (Stage2Header *)Stage2Location;
 
-	if (count > 30)
-		count = 30;
+	// Stage 2 must fit into the reserved sectors and below the VBR. If
+	// there are not even 3 reserved sectors, Verify() fails further down.
+	uint16_t max = super->ReservedSectors() - 2;
 
-	// XXX: we boldly assume the partition to be cylinder
-	// aligned, so the stupid CHS arithmetic won't overflow.
-	CHSPacked src = part.StartAddressCHS();
+	if (max > Stage2MaxSize / super->BytesPerSector())
+		max = Stage2MaxSize / super->BytesPerSector();
 
-	src.SetSector(src.Sector() + 2);
+	// Load the header sector, then exactly as much as it asks for
+	uint16_t count = 1, next;
 
-	auto *dst = (uint8_t *)Stage2Location;
+	for (;;) {
+		if (!LoadStage2(disk, ent, count))
+			DumpMessageAndHang(msgErrLoad);
 
-	if (!disk.LoadSectors(src, dst, count))
-		DumpMessageAndHang(msgErrLoad);
+		next = hdr->SectorCount() < max ? hdr->SectorCount() : max;
+		if (next == count)
+			break;
 
-	auto *hdr = (Stage2Header *)dst;
+		count = next;
+	}
 
-	if (!hdr->Verify(count))
+	if (!hdr->Verify(max))
 		DumpMessageAndHang(msgErrBroken);
 
 	// Enter stage 2
 	hdr->SetBiosBootDrive(disk);
-	hdr->SetBootMBREntry(part);
+	hdr->SetBootMBREntry(*ent);
 
-	return dst + sizeof(*hdr);
+	return hdr + 1;
 }